@@ -13,14 +13,25 @@
 #include <math.h>
 #include <stdarg.h>
 
-#define LOG(format, args...)                                                   \
-    fprintf(stderr, "%s: %d, " format "\n", __func__, __LINE__, ##args);
-
-#define LOG_EXPECT(cond, format, args...)                                      \
-    if (!(cond)) {                                                             \
-        LOG(format, args);                                                     \
-        exit(-1);                                                              \
-    }
+#if defined(__unix__) || defined(__APPLE__)
+#define J4ON_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define J4ON_POSIX 0
+#endif
+
+// Malformed input: record the error at p, the parse function returns NULL.
+#define J4ON_EXPECT(json, cond, code, p)                                       \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            (json)->error = (code);                                            \
+            (json)->error_at = (p);                                            \
+            return NULL;                                                       \
+        }                                                                      \
+    } while (0)
 
 #define J4ON_VALUE_INIT(j4on, value, type)                                     \
     do {                                                                       \
@@ -39,9 +50,13 @@
         }                                                                      \
     } while (0)
 
+// returns 0 from the caller when the pool is out of memory.
 #define J4ON_LINK_PAIR(list, tmp_list, value)                                  \
     do {                                                                       \
-        j4on_pair *j4_pair = (j4on_pair *)malloc(sizeof(j4on_pair));           \
+        j4on_pair *j4_pair =                                                   \
+            (j4on_pair *)j4on_pool_alloc(json->pool, sizeof(j4on_pair));       \
+        if (!j4_pair)                                                          \
+            return 0;                                                          \
         J4ON_VALUE_INIT(j4_pair, j4_pair->j4_value, J4_PAIR);                  \
         J4ON_VALUE_INIT(j4_pair, j4_pair->j4_key.j4_value, J4_PAIR);           \
         j4_pair->j4_key.j4_value = *(key);                                     \
@@ -53,23 +68,167 @@ const char *value_type_stringify[9] = {"UNKNOWN", "NULL",   "FALSE",
                                        "TRUE",    "NUMBER", "STRING",
                                        "ARRAY",   "OBJECT", "PAIR"};
 
-void j4on_load(struct json *json, const char *filename) {
+static const char *error_stringify[13] = {"no error",
+                                          "invalid literal",
+                                          "invalid number",
+                                          "unterminated string",
+                                          "expected a value",
+                                          "expected a key",
+                                          "expected ':'",
+                                          "expected ',' or a closing bracket",
+                                          "nesting too deep",
+                                          "invalid escape",
+                                          "unescaped control character",
+                                          "invalid UTF-8",
+                                          "out of memory"};
+
+void j4on_pool_init(struct j4on_pool *pool, size_t block_size) {
+    pool->head = pool->current = NULL;
+    pool->ptr = pool->end = NULL;
+    pool->block_size = block_size ? block_size : J4ON_POOL_BLOCK_SIZE;
+}
+
+static void j4on_pool_use(struct j4on_pool *pool,
+                          struct j4on_pool_block *block) {
+    pool->current = block;
+    pool->ptr = (char *)(block + 1);
+    pool->end = pool->ptr + block->size;
+}
+
+void *j4on_pool_alloc(struct j4on_pool *pool, size_t n) {
+    // keep every node aligned as malloc does.
+    n = (n + sizeof(void *) * 2 - 1) & ~(sizeof(void *) * 2 - 1);
+
+    // blocks kept by j4on_pool_reset() first.
+    while (pool->current && (size_t)(pool->end - pool->ptr) < n &&
+           pool->current->next)
+        j4on_pool_use(pool, pool->current->next);
+
+    if (!pool->current || (size_t)(pool->end - pool->ptr) < n) {
+        size_t size = n > pool->block_size ? n : pool->block_size;
+        struct j4on_pool_block *block = (struct j4on_pool_block *)malloc(
+            sizeof(struct j4on_pool_block) + size);
+        if (!block)
+            return NULL;
+        block->next = NULL;
+        block->size = size;
+        if (pool->current)
+            pool->current->next = block;
+        else
+            pool->head = block;
+        j4on_pool_use(pool, block);
+    }
+
+    void *p = pool->ptr;
+    pool->ptr += n;
+    return p;
+}
+
+// rewind to the first block, blocks are kept for the next parse.
+void j4on_pool_reset(struct j4on_pool *pool) {
+    if (pool->head)
+        j4on_pool_use(pool, pool->head);
+}
+
+void j4on_pool_destroy(struct j4on_pool *pool) {
+    struct j4on_pool_block *block = pool->head;
+    while (block) {
+        struct j4on_pool_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    j4on_pool_init(pool, pool->block_size);
+}
+
+#if J4ON_POSIX
+// Map a regular file read only, followed by at least J4ON_PADDING zero
+// bytes of an anonymous page, so the content is NUL terminated in place.
+static int j4on_map(struct json *json, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    size_t len = st.st_size;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t total = (len + page - 1) / page * page +
+                   (J4ON_PADDING + page - 1) / page * page;
+
+    // reserve the whole range zeroed, then put the file over its start.
+    char *base = mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (base != MAP_FAILED &&
+        mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+            MAP_FAILED) {
+        munmap(base, total);
+        base = MAP_FAILED;
+    }
+    close(fd);
+    if (base == MAP_FAILED)
+        return 0;
+
+    posix_madvise(base, len, POSIX_MADV_SEQUENTIAL);
+    json->base = json->content = base;
+    json->mapped = total;
+    return 1;
+}
+#endif
+
+// 0 on success, -1 if the file can not be opened and content is empty.
+int j4on_load(struct json *json, const char *filename) {
+    static char empty[1];
+    json->flags = 0;
+    json->max_depth = 0;
+    json->base = NULL;
+    json->mapped = 0;
+
+#if J4ON_POSIX
+    if (j4on_map(json, filename))
+        return 0;
+#endif
+
     FILE *fp = fopen(filename, "r");
-    LOG_EXPECT(fp, "File %s open failed.", filename);
+    if (!fp) {
+        json->content = empty;
+        return -1;
+    }
 
     fseek(fp, 0, SEEK_END);
-    int len = ftell(fp);
+    long len = ftell(fp);
     fseek(fp, 0, SEEK_SET);
-    json->content = (char *)malloc(len + 1);
+    if (len < 0)
+        len = 0;
+    json->base = json->content = (char *)malloc(len + J4ON_PADDING);
+    if (!json->base) {
+        fclose(fp);
+        json->content = empty;
+        return -1;
+    }
     // avoid new line's diff in CRLF and LF
-    memset(json->content, '\0', len + 1);
-    fread(json->content, sizeof(char), len, fp);
+    memset(json->content, '\0', len + J4ON_PADDING);
+    len = fread(json->content, sizeof(char), len, fp);
     json->content[len] = '\0';
     fclose(fp);
+    return 0;
 }
 
-// \TODO Fix free error, json->content arrived end after parse.
-void j4on_free(struct json *json) { free(json->content); }
+void j4on_free(struct json *json) {
+#if J4ON_POSIX
+    if (json->mapped) {
+        munmap(json->base, json->mapped);
+        json->base = NULL;
+        json->mapped = 0;
+        return;
+    }
+#endif
+    free(json->base);
+    json->base = NULL;
+}
 
 static void skip_whitespace(struct json *json) {
     char *p = json->content;
@@ -98,12 +257,13 @@ static struct j4on_value *j4on_parse_literal(struct json *json,
     const char *q = literal;
     char *p = json->content;
     for (size_t i = 0; i < len; i++)
-        LOG_EXPECT(*p++ == *q++, "expeted '%s', actual '%.*s'", literal, 10,
-                   json->content);
+        J4ON_EXPECT(json, *p++ == *q++, J4ON_ERR_LITERAL, json->content);
 
     json->content = p;
 
-    j4on_literal *j4_literal = (j4on_literal *)malloc(sizeof(j4on_literal));
+    j4on_literal *j4_literal =
+        (j4on_literal *)j4on_pool_alloc(json->pool, sizeof(j4on_literal));
+    J4ON_EXPECT(json, j4_literal, J4ON_ERR_NOMEM, json->content);
     J4ON_VALUE_INIT(j4_literal, j4_literal->j4_value, type);
 
     return &j4_literal->j4_value;
@@ -118,7 +278,7 @@ static struct j4on_value *j4on_parse_number(struct json *json) {
         p++;
 
     // integer
-    LOG_EXPECT(isdigit(*p), "Expected digit, actual '%.*s'", 10, json->content);
+    J4ON_EXPECT(json, isdigit(*p), J4ON_ERR_NUMBER, q);
 
     if (*p == '0') {
         p++;
@@ -130,80 +290,140 @@ static struct j4on_value *j4on_parse_number(struct json *json) {
     // fractional part
     if (*p == '.') {
         p++;
+        J4ON_EXPECT(json, isdigit(*p), J4ON_ERR_NUMBER, q);
         while (isdigit(*p))
             p++;
     }
 
     // exponent part
-    if (*p == 'e' || *p == 'E')
-        p++;
-    if (*p == '+' || *p == '-')
-        p++;
-    while (isdigit(*p))
+    if (*p == 'e' || *p == 'E') {
         p++;
+        if (*p == '+' || *p == '-')
+            p++;
+        J4ON_EXPECT(json, isdigit(*p), J4ON_ERR_NUMBER, q);
+        while (isdigit(*p))
+            p++;
+    }
 
     // converting parsed string to number and keep the number in correct range
     double number = strtod(q, &p);
-    LOG_EXPECT(errno != ERANGE && (number != HUGE_VAL && number != -HUGE_VAL),
-               "Numerical result out of range: '%lf' at '%.*s'", number, 24,
-               json->content)
+    J4ON_EXPECT(json, number != HUGE_VAL && number != -HUGE_VAL,
+                J4ON_ERR_NUMBER, q);
 
     // character to number parse completion
     json->content = p;
 
     // handle new json node
-    j4on_number *j4_number = (j4on_number *)malloc(sizeof(j4on_number));
+    j4on_number *j4_number =
+        (j4on_number *)j4on_pool_alloc(json->pool, sizeof(j4on_number));
+    J4ON_EXPECT(json, j4_number, J4ON_ERR_NOMEM, json->content);
     J4ON_VALUE_INIT(j4_number, j4_number->j4_value, J4_NUMBER);
     j4_number->number = number;
     
     return &j4_number->j4_value;
 }
 
+static int parse_hex4(const char *p, unsigned *cp) {
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        *cp <<= 4;
+        if (p[i] >= '0' && p[i] <= '9')
+            *cp |= p[i] - '0';
+        else if (p[i] >= 'a' && p[i] <= 'f')
+            *cp |= p[i] - 'a' + 10;
+        else if (p[i] >= 'A' && p[i] <= 'F')
+            *cp |= p[i] - 'A' + 10;
+        else
+            return 0;
+    }
+    return 1;
+}
+
+// length of the UTF-8 sequence at p, 0 if it is malformed. The NUL
+// terminator is no continuation byte, so a cut sequence is malformed too.
+static int utf8_sequence(const unsigned char *p) {
+    unsigned char lo = 0x80, hi = 0xBF;
+    int n;
+    if (p[0] < 0x80)
+        return 1;
+    if (p[0] < 0xC2) // continuation or overlong
+        return 0;
+    if (p[0] < 0xE0) {
+        n = 2;
+    } else if (p[0] < 0xF0) {
+        n = 3;
+        lo = p[0] == 0xE0 ? 0xA0 : 0x80; // overlong
+        hi = p[0] == 0xED ? 0x9F : 0xBF; // surrogate
+    } else if (p[0] < 0xF5) {
+        n = 4;
+        lo = p[0] == 0xF0 ? 0x90 : 0x80; // overlong
+        hi = p[0] == 0xF4 ? 0x8F : 0xBF; // above U+10FFFF
+    } else {
+        return 0;
+    }
+    for (int i = 1; i < n; i++, lo = 0x80, hi = 0xBF)
+        if (p[i] < lo || p[i] > hi)
+            return 0;
+    return n;
+}
+
+// at the opening quote.
 static struct j4on_value *j4on_parse_string(struct json *json) {
     char *p = json->content;
-    LOG_EXPECT(*p == '\"', "Expected '\"', actual '%c' in string '%.*s'", *p,
-               16, p);
     p++; // skip '\"'
-    while (*p != '\0') {
-        if (*p == '\\') {
-            p++; // skip '\\'
-            switch (*p) {
+    unsigned flags = 0;
+    unsigned cp;
+    while (*p != '\0' && *p != '\"') {
+        unsigned char ch = *p;
+        if (ch == '\\') {
+            flags |= J4ON_STR_ESCAPED;
+            switch (p[1]) {
             case '\"':
-                break;
             case '\\':
-                break;
             case '/':
-                break;
             case 'b':
-                break;
             case 'f':
-                break;
             case 'n':
-                break;
             case 'r':
-                break;
             case 't':
+                p += 2;
+                break;
+            case 'u': // a lone surrogate is decoded to U+FFFD.
+                J4ON_EXPECT(json, parse_hex4(p + 2, &cp), J4ON_ERR_ESCAPE, p);
+                p += 6;
                 break;
             default:
-                LOG("Illegal escape character '\%c'.", *p);
+                J4ON_EXPECT(json, p[1] == '\0', J4ON_ERR_ESCAPE, p);
+                p++; // left open, reported below
                 break;
             }
-        } else if (*p == '\"') {
-            break;
+        } else {
+            J4ON_EXPECT(json, ch >= 0x20, J4ON_ERR_CONTROL, p);
+            int n = utf8_sequence((const unsigned char *)p);
+            J4ON_EXPECT(json, n > 0, J4ON_ERR_UTF8, p);
+            p += n;
         }
-        p++;
     }
 
-    LOG_EXPECT(*p == '\"', "Expected '\"', actual '%c' in string '%.*s'", *p,
-               16, p);
+    J4ON_EXPECT(json, *p == '\"', J4ON_ERR_STRING, json->content);
     p++; // skip '\"'
 
-    j4on_string *j4_string = (j4on_string *)malloc(sizeof(j4on_string));
+    j4on_string *j4_string =
+        (j4on_string *)j4on_pool_alloc(json->pool, sizeof(j4on_string));
+    J4ON_EXPECT(json, j4_string, J4ON_ERR_NOMEM, json->content);
     j4_string->s_len = p - json->content - 2;
-    j4_string->str = (char *)malloc(j4_string->s_len + 1);
-    memmove(j4_string->str, json->content + 1,
-            j4_string->s_len); // in order to skip \", so + 1
-    j4_string->str[j4_string->s_len] = '\0';
+    if (json->flags & J4ON_ZERO_COPY) {
+        // in order to skip \", so + 1
+        j4_string->str = json->content + 1;
+        flags |= J4ON_STR_VIEW;
+    } else {
+        j4_string->str =
+            (char *)j4on_pool_alloc(json->pool, j4_string->s_len + 1);
+        J4ON_EXPECT(json, j4_string->str, J4ON_ERR_NOMEM, json->content);
+        memmove(j4_string->str, json->content + 1, j4_string->s_len);
+        j4_string->str[j4_string->s_len] = '\0';
+    }
+    j4_string->flags = flags;
     J4ON_VALUE_INIT(j4_string, j4_string->j4_value, J4_STRING);
 
     json->content = p;
@@ -211,93 +431,63 @@ static struct j4on_value *j4on_parse_string(struct json *json) {
     return &j4_string->j4_value;
 }
 
-static struct j4on_value *j4on_parse_value(struct json *json);
-
-static struct j4on_value *j4on_parse_array(struct json *json) {
-    LOG_EXPECT(*json->content++ == '[', "expected '[', %.*s", 16,
-               json->content);
-
-    j4on_array *j4_array = (j4on_array *)malloc(sizeof(j4on_array));
-    J4ON_VALUE_INIT(j4_array, j4_array->j4_value, J4_ARRAY);
-
-    struct slist *list;
-    struct j4on_value *value;
-    while (*json->content != '\0') {
-        skip_whitespace(json);
-        if (*json->content == ']')
-            break;
-
-        value = j4on_parse_value(json);
-
-        // link the new node by the list, and j4_array as the array list head.
-        J4ON_LINK_VALUE(j4_array->j4_value.j4_list, list, value);
-
-        skip_whitespace(json);
-        if (*json->content == ',') {
-            json->content++;
-            LOG_EXPECT(!next_is_end_char(json, ']'), "expected ',', %.*s", 16,
-                       json->content);
-        } else if (!next_is_end_char(json, ']')) {
-            LOG_EXPECT(*json->content == ',', "expected ',', %.*s", 16,
-                       json->content);
-            json->content++;
-        } else {
-            break;
-        }
+// open array or object of the iterative parser.
+struct j4on_frame {
+    struct j4on_value *container;
+    struct slist *tail;      // last linked child
+    struct j4on_value *key;  // key of the member being parsed
+};
+
+#define J4ON_FRAMES_INIT 32
+
+// one frame per nesting level, grown from the pool up to json->max_depth.
+static struct j4on_frame *j4on_push_frame(struct json *json, size_t depth) {
+    size_t max_depth = json->max_depth ? json->max_depth : J4ON_MAX_DEPTH;
+    J4ON_EXPECT(json, depth < max_depth, J4ON_ERR_DEPTH, json->content);
+
+    if (depth == json->frames_size) {
+        size_t size = depth ? depth * 2 : J4ON_FRAMES_INIT;
+        struct j4on_frame *frames = (struct j4on_frame *)j4on_pool_alloc(
+            json->pool, size * sizeof(struct j4on_frame));
+        J4ON_EXPECT(json, frames, J4ON_ERR_NOMEM, json->content);
+        if (depth)
+            memcpy(frames, json->frames, depth * sizeof(struct j4on_frame));
+        json->frames = frames;
+        json->frames_size = size;
     }
 
-    LOG_EXPECT(*json->content++ == ']', "expected ']', %.*s", 16,
-               json->content);
-
-    return &j4_array->j4_value;
+    return &json->frames[depth];
 }
 
-static struct j4on_value *j4on_parse_object(struct json *json) {
-    LOG_EXPECT(*json->content++ == '{', "expected '{', %.*s", 16,
-               json->content);
-
-    j4on_object *j4_object = (j4on_object *)malloc(sizeof(j4on_object));
-    J4ON_VALUE_INIT(j4_object, j4_object->j4_value, J4_OBJECT);
-
-    struct slist *list;
-    struct j4on_value *key, *value;
-    while (*json->content != '\0') {
-        skip_whitespace(json);
-        if (*json->content == '}')
-            break;
-        key = j4on_parse_string(json);
-
-        skip_whitespace(json);
-        LOG_EXPECT(*json->content++ == ':', "member expected ':', %.*s", 16,
-                   json->content);
-
-        value = j4on_parse_value(json);
+// string ':', returns the key.
+static struct j4on_value *j4on_parse_key(struct json *json) {
+    struct j4on_value *key;
+    skip_whitespace(json);
+    J4ON_EXPECT(json, *json->content == '\"', J4ON_ERR_KEY, json->content);
+    key = j4on_parse_string(json);
+    if (!key)
+        return NULL;
+    skip_whitespace(json);
+    J4ON_EXPECT(json, *json->content == ':', J4ON_ERR_COLON, json->content);
+    json->content++;
+    return key;
+}
 
+// 0 if the pool is out of memory.
+static int j4on_link(struct json *json, struct j4on_frame *frame,
+                     struct j4on_value *value) {
+    if (frame->container->j4_type == J4_ARRAY) {
+        // link the new node by the list, and container as the list head.
+        J4ON_LINK_VALUE(frame->container->j4_list, frame->tail, value);
+    } else {
         // linked the pair
-        J4ON_LINK_PAIR(j4_object->j4_value.j4_list, list, value);
-
-        skip_whitespace(json);
-        if (*json->content == ',') {
-            json->content++;
-            LOG_EXPECT(!next_is_end_char(json, '}'), "expected ',', %.*s", 16,
-                       json->content);
-        } else if (!next_is_end_char(json, '}')) {
-            LOG_EXPECT(*json->content == ',', "expected ',', %.*s", 16,
-                       json->content);
-            json->content++;
-        } else {
-            break;
-        }
+        struct j4on_value *key = frame->key;
+        J4ON_LINK_PAIR(frame->container->j4_list, frame->tail, value);
     }
-
-    LOG_EXPECT(*json->content++ == '}', "expected '}', %.*s", 16,
-               json->content);
-
-    return &j4_object->j4_value;
+    return 1;
 }
 
-static struct j4on_value *j4on_parse_value(struct json *json) {
-    skip_whitespace(json);
+static struct j4on_value *j4on_parse_scalar(struct json *json) {
     switch (*json->content) {
     case 'n':
         return j4on_parse_literal(json, "null", 4, J4_NULL);
@@ -307,25 +497,237 @@ static struct j4on_value *j4on_parse_value(struct json *json) {
         return j4on_parse_literal(json, "false", 5, J4_FALSE);
     case '\"':
         return j4on_parse_string(json);
-    case '[':
-        return j4on_parse_array(json);
-    case '{':
-        return j4on_parse_object(json);
     default:
+        J4ON_EXPECT(json, *json->content == '-' || isdigit(*json->content),
+                    J4ON_ERR_VALUE, json->content);
         return j4on_parse_number(json);
     }
 }
 
-// linked the value abreast in first depth
-void j4on_parse(struct slist *head, struct json *json) {
+// Iterative parser, open arrays and objects live on json->frames instead of
+// the call stack, so only the nesting depth costs memory.
+static struct j4on_value *j4on_parse_value(struct json *json) {
+    struct j4on_value *value;
+    struct j4on_frame *frame;
+    size_t depth = 0;
+    char end;
+
+    for (;;) {
+        // parse one value, a container is left open on the frames.
+        skip_whitespace(json);
+        if (*json->content == '[' || *json->content == '{') {
+            frame = j4on_push_frame(json, depth++);
+            if (!frame)
+                return NULL;
+            if (*json->content == '[') {
+                j4on_array *j4_array = (j4on_array *)j4on_pool_alloc(
+                    json->pool, sizeof(j4on_array));
+                J4ON_EXPECT(json, j4_array, J4ON_ERR_NOMEM, json->content);
+                J4ON_VALUE_INIT(j4_array, j4_array->j4_value, J4_ARRAY);
+                frame->container = &j4_array->j4_value;
+                end = ']';
+            } else {
+                j4on_object *j4_object = (j4on_object *)j4on_pool_alloc(
+                    json->pool, sizeof(j4on_object));
+                J4ON_EXPECT(json, j4_object, J4ON_ERR_NOMEM, json->content);
+                J4ON_VALUE_INIT(j4_object, j4_object->j4_value, J4_OBJECT);
+                frame->container = &j4_object->j4_value;
+                end = '}';
+            }
+            frame->tail = NULL;
+            json->content++;
+
+            if (!next_is_end_char(json, end)) {
+                if (end == '}' && !(frame->key = j4on_parse_key(json)))
+                    return NULL;
+                continue;
+            }
+
+            // empty
+            J4ON_EXPECT(json, *json->content == end, J4ON_ERR_END,
+                        json->content);
+            json->content++;
+            value = frame->container;
+            depth--;
+        } else {
+            value = j4on_parse_scalar(json);
+            if (!value)
+                return NULL;
+        }
+
+        // link the finished value, close the containers it completes.
+        for (;;) {
+            if (depth == 0)
+                return value;
+
+            frame = &json->frames[depth - 1];
+            J4ON_EXPECT(json, j4on_link(json, frame, value), J4ON_ERR_NOMEM,
+                        json->content);
+            end = frame->container->j4_type == J4_ARRAY ? ']' : '}';
+
+            skip_whitespace(json);
+            if (*json->content == ',') {
+                json->content++;
+                J4ON_EXPECT(json, !next_is_end_char(json, end),
+                            end == '}' ? J4ON_ERR_KEY : J4ON_ERR_VALUE,
+                            json->content);
+                if (end == '}' && !(frame->key = j4on_parse_key(json)))
+                    return NULL;
+                break;
+            }
+
+            J4ON_EXPECT(json, *json->content == end, J4ON_ERR_END,
+                        json->content);
+            json->content++;
+            value = frame->container;
+            depth--;
+        }
+    }
+}
+
+// linked the value abreast in first depth, all nodes are allocated from pool.
+// Stops at the first malformed value, the values before it stay linked and
+// json->error_at points at the error.
+j4on_error j4on_parse(struct slist *head, struct json *json,
+                      struct j4on_pool *pool) {
     struct j4on_value *value;
+    json->pool = pool;
+    json->frames = NULL;
+    json->frames_size = 0;
+    json->start = json->content;
+    json->error = J4ON_OK;
+    json->error_at = NULL;
     struct slist *list = head;
     skip_whitespace(json);
     while (*json->content != '\0') {
         value = j4on_parse_value(json);
+        if (!value)
+            return json->error;
         list->breadth = &value->j4_list;
         list = list->breadth;
+        skip_whitespace(json);
     }
+    return J4ON_OK;
+}
+
+const char *j4on_error_string(j4on_error error) {
+    return error_stringify[error];
+}
+
+// 1-based line and column of the last error, counted only when asked for.
+void j4on_error_position(const struct json *json, size_t *line,
+                         size_t *column) {
+    const char *p, *begin = json->start;
+    *line = 1;
+    if (!json->error_at) {
+        *column = 1;
+        return;
+    }
+    for (p = json->start; p < json->error_at; p++) {
+        if (*p == '\n') {
+            ++*line;
+            begin = p + 1;
+        }
+    }
+    *column = json->error_at - begin + 1;
+}
+
+static size_t encode_utf8(unsigned cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// decode escapes of len bytes at str into out, returns the decoded length.
+static size_t unescape(const char *str, size_t len, char *out) {
+    const char *end = str + len;
+    char *q = out;
+    unsigned cp, lo;
+    while (str < end) {
+        if (*str != '\\') {
+            *q++ = *str++;
+            continue;
+        }
+        if (++str == end)
+            break;
+        switch (*str) {
+        case 'b':
+            *q++ = '\b';
+            break;
+        case 'f':
+            *q++ = '\f';
+            break;
+        case 'n':
+            *q++ = '\n';
+            break;
+        case 'r':
+            *q++ = '\r';
+            break;
+        case 't':
+            *q++ = '\t';
+            break;
+        case 'u':
+            if (end - str < 5 || !parse_hex4(str + 1, &cp)) {
+                *q++ = 'u';
+                break;
+            }
+            str += 4;
+            // surrogate pair, a lone surrogate becomes U+FFFD.
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                if (end - str >= 7 && str[1] == '\\' && str[2] == 'u' &&
+                    parse_hex4(str + 3, &lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    str += 6;
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                cp = 0xFFFD;
+            }
+            q += encode_utf8(cp, q);
+            break;
+        default: // '\"', '\\', '/'
+            *q++ = *str;
+        }
+        str++;
+    }
+    return q - out;
+}
+
+// NUL-terminated and unescaped characters of string, a view or an escaped
+// string is decoded into pool on the first call. NULL if pool is out of
+// memory.
+const char *j4on_string_value(struct j4on_string *string,
+                              struct j4on_pool *pool) {
+    if (!string->flags)
+        return string->str;
+
+    char *str = (char *)j4on_pool_alloc(pool, string->s_len + 1);
+    if (!str)
+        return NULL;
+    if (string->flags & J4ON_STR_ESCAPED)
+        string->s_len = unescape(string->str, string->s_len, str);
+    else
+        memcpy(str, string->str, string->s_len);
+    str[string->s_len] = '\0';
+    string->str = str;
+    string->flags = 0;
+    return str;
 }
 
 void j4on_travel(struct slist *list) {
@@ -52,10 +52,15 @@ typedef struct j4on_number {
     double number;
 } j4on_number;
 
+// j4on_string flags.
+#define J4ON_STR_VIEW 1    // str points into json content, not NUL-terminated
+#define J4ON_STR_ESCAPED 2 // str still has its escapes
+
 typedef struct j4on_string {
     struct j4on_value j4_value;
     char *str;
     size_t s_len;
+    unsigned flags;
 } j4on_string;
 
 typedef struct j4on_array {
@@ -71,14 +76,76 @@ typedef struct j4on_pair {
     struct j4on_value j4_value;
 } j4on_pair;
 
+// Memory pool for all nodes of a parse, freed in one shot.
+struct j4on_pool_block {
+    struct j4on_pool_block *next;
+    size_t size;
+};
+
+struct j4on_pool {
+    struct j4on_pool_block *head, *current;
+    char *ptr, *end;
+    size_t block_size;
+};
+
+#define J4ON_POOL_BLOCK_SIZE 4096
+
+// struct json flags.
+#define J4ON_ZERO_COPY 1 // strings are views into content, decoded on demand
+
+#define J4ON_MAX_DEPTH 1024 // default max nesting of arrays and objects
+
+#define J4ON_PADDING 64 // zero bytes after loaded content
+
+// j4on_parse errors.
+typedef enum {
+    J4ON_OK,
+    J4ON_ERR_LITERAL, // misspelt null, true or false
+    J4ON_ERR_NUMBER,  // malformed or beyond the range of a double
+    J4ON_ERR_STRING,  // string left open
+    J4ON_ERR_VALUE,   // a value expected
+    J4ON_ERR_KEY,     // a key expected
+    J4ON_ERR_COLON,   // ':' expected after a key
+    J4ON_ERR_END,     // ',' or the closing bracket expected
+    J4ON_ERR_DEPTH,   // nested deeper than max_depth
+    J4ON_ERR_ESCAPE,  // unknown escape or \u without 4 hex digits
+    J4ON_ERR_CONTROL, // raw control character in a string
+    J4ON_ERR_UTF8,    // malformed UTF-8 in a string
+    J4ON_ERR_NOMEM    // the pool could not grow
+} j4on_error;
+
+struct j4on_frame;
+
 struct json {
     char *content;
+    struct j4on_pool *pool;
+    unsigned flags;
+    size_t max_depth; // 0 for J4ON_MAX_DEPTH
+    struct j4on_frame *frames;
+    size_t frames_size;
+    char *base;    // loaded file, content moves on while parsing
+    size_t mapped; // bytes mapped at base, 0 if malloc'ed
+    char *start;      // content when j4on_parse began
+    j4on_error error; // of the last j4on_parse
+    char *error_at;   // where in content the error was found
 };
 
-void j4on_load(struct json *json, const char *filename);
+void j4on_pool_init(struct j4on_pool *pool, size_t block_size);
+// NULL if the system allocator fails, j4on_parse then returns J4ON_ERR_NOMEM.
+void *j4on_pool_alloc(struct j4on_pool *pool, size_t n);
+void j4on_pool_reset(struct j4on_pool *pool);
+void j4on_pool_destroy(struct j4on_pool *pool);
+
+int j4on_load(struct json *json, const char *filename);
 void j4on_free(struct json *json);
-void j4on_parse(struct slist *list, struct json *json);
+j4on_error j4on_parse(struct slist *list, struct json *json,
+                      struct j4on_pool *pool);
+const char *j4on_error_string(j4on_error error);
+void j4on_error_position(const struct json *json, size_t *line,
+                         size_t *column);
 void j4on_travel(struct slist *list);
+const char *j4on_string_value(struct j4on_string *string,
+                              struct j4on_pool *pool);
 char *j4on_format(struct slist *list, const char *json);
 
 #endif // J4ON_H
\ No newline at end of file
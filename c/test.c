@@ -1,23 +1,173 @@
 #include "j4on.h"
 
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct j4on_pool pool;
+
 void test_parse_value(const char *filename) {
     struct json json;
     j4on_load(&json, filename);
-    struct slist list, *pos;
+    struct slist list;
     slist_init(&list);
-    j4on_parse(&list, &json);
+    j4on_pool_reset(&pool);
+    j4on_parse(&list, &json, &pool);
     // j4on_travel(list.breadth);
+    j4on_free(&json);
+}
+
+void test_zero_copy() {
+    char content[] = "[\"plain\", \"a\\tb\\u00e9\"]";
+    struct json json = {0};
+    json.content = content;
+    json.flags = J4ON_ZERO_COPY;
+    struct slist list;
+    slist_init(&list);
+    j4on_pool_reset(&pool);
+    j4on_parse(&list, &json, &pool);
+
+    struct j4on_value *array =
+        slist_entry(list.breadth, struct j4on_value, j4_list);
+    j4on_string *plain = (j4on_string *)slist_entry(
+        array->j4_list.depth, struct j4on_value, j4_list);
+    j4on_string *escaped = (j4on_string *)slist_entry(
+        plain->j4_value.j4_list.breadth, struct j4on_value, j4_list);
+
+    assert(plain->str == content + 2 && plain->s_len == 5);
+    assert(plain->flags == J4ON_STR_VIEW);
+    assert(strcmp(j4on_string_value(plain, &pool), "plain") == 0);
+    assert(escaped->flags == (J4ON_STR_VIEW | J4ON_STR_ESCAPED));
+    assert(strcmp(j4on_string_value(escaped, &pool), "a\tb\xc3\xa9") == 0);
+}
+
+void test_deep_nesting() {
+    size_t depth = 100000;
+    char *content = (char *)malloc(depth * 2 + 1);
+    memset(content, '[', depth);
+    memset(content + depth, ']', depth);
+    content[depth * 2] = '\0';
+
+    struct json json = {0};
+    json.content = content;
+    json.max_depth = depth;
+    struct slist list;
+    slist_init(&list);
+    j4on_pool_reset(&pool);
+    j4on_parse(&list, &json, &pool);
+
+    struct j4on_value *value =
+        slist_entry(list.breadth, struct j4on_value, j4_list);
+    size_t n = 1;
+    while (value->j4_list.depth) {
+        value = slist_entry(value->j4_list.depth, struct j4on_value, j4_list);
+        n++;
+    }
+    assert(n == depth && value->j4_type == J4_ARRAY);
+    free(content);
+}
+
+void test_parse_error() {
+    struct {
+        const char *content;
+        j4on_error error;
+        size_t offset;
+    } cases[] = {{"[1,]", J4ON_ERR_VALUE, 3},
+                 {"{\"a\":1,}", J4ON_ERR_KEY, 7},
+                 {"[1 2]", J4ON_ERR_END, 3},
+                 {"[1", J4ON_ERR_END, 2},
+                 {"{\"a\" 1}", J4ON_ERR_COLON, 5},
+                 {"{1:2}", J4ON_ERR_KEY, 1},
+                 {"[tru]", J4ON_ERR_LITERAL, 1},
+                 {"[-x]", J4ON_ERR_NUMBER, 1},
+                 {"1.", J4ON_ERR_NUMBER, 0},
+                 {"1e999", J4ON_ERR_NUMBER, 0},
+                 {"[\"ab", J4ON_ERR_STRING, 1},
+                 {"\"ab\\", J4ON_ERR_STRING, 0},
+                 {"]", J4ON_ERR_VALUE, 0},
+                 {"[\"a\\x\"]", J4ON_ERR_ESCAPE, 3},
+                 {"\"\\u12g4\"", J4ON_ERR_ESCAPE, 1},
+                 {"\"a\tb\"", J4ON_ERR_CONTROL, 2},
+                 {"\"\xc0\xaf\"", J4ON_ERR_UTF8, 1},
+                 {"\"\xed\xa0\x80\"", J4ON_ERR_UTF8, 1},
+                 {"\"ab\xe2\x82\"", J4ON_ERR_UTF8, 3},
+                 {"\"\xf4\x90\x80\x80\"", J4ON_ERR_UTF8, 1}};
+    char content[32];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        strcpy(content, cases[i].content);
+        struct json json = {0};
+        json.content = content;
+        struct slist list;
+        slist_init(&list);
+        j4on_pool_reset(&pool);
+        assert(j4on_parse(&list, &json, &pool) == cases[i].error);
+        assert(json.error_at == content + cases[i].offset);
+    }
+
+    // multibyte text and lone surrogate escapes are well formed.
+    char text[] = "[\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\", \"\\ud800\"]";
+    struct json valid = {0};
+    valid.content = text;
+    struct slist list;
+    slist_init(&list);
+    j4on_pool_reset(&pool);
+    assert(j4on_parse(&list, &valid, &pool) == J4ON_OK);
+
+    // line and column of the error are counted from the content.
+    char lines[] = "{\n  \"a\": 1,\n  \"b\" 2\n}";
+    struct json json = {0};
+    json.content = lines;
+    json.max_depth = 2;
+    slist_init(&list);
+    j4on_pool_reset(&pool);
+    assert(j4on_parse(&list, &json, &pool) == J4ON_ERR_COLON);
+    size_t line, column;
+    j4on_error_position(&json, &line, &column);
+    assert(line == 3 && column == 7);
+    assert(strcmp(j4on_error_string(json.error), "expected ':'") == 0);
+
+    char deep[] = "[[[]]]";
+    json = (struct json){0};
+    json.content = deep;
+    json.max_depth = 2;
+    assert(j4on_parse(&list, &json, &pool) == J4ON_ERR_DEPTH);
+    assert(json.error_at == deep + 2);
+
+    assert(j4on_load(&json, "../json_file/missing.json") == -1);
+    assert(j4on_parse(&list, &json, &pool) == J4ON_OK && !list.breadth);
+}
+
+// failed allocations below, ASan returns NULL for them too.
+const char *__asan_default_options(void) {
+    return "allocator_may_return_null=1";
+}
+
+void test_out_of_memory() {
+    struct j4on_pool huge;
+    j4on_pool_init(&huge, SIZE_MAX / 4);
+    assert(!j4on_pool_alloc(&huge, 1));
+
+    char content[] = "[1, \"a\"]";
+    struct json json = {0};
+    json.content = content;
+    struct slist list;
+    slist_init(&list);
+    assert(j4on_parse(&list, &json, &huge) == J4ON_ERR_NOMEM);
+    assert(strcmp(j4on_error_string(json.error), "out of memory") == 0);
+    j4on_pool_destroy(&huge);
 }
 
-void test_parse_null() { test_parse_value("../json/null.json"); }
-void test_parse_false() { test_parse_value("../json/false.json"); }
-void test_parse_true() { test_parse_value("../json/true.json"); }
-void test_parse_number() { test_parse_value("../json/number.json"); }
-void test_parse_string() { test_parse_value("../json/string.json"); }
-void test_parse_array() { test_parse_value("../json/array.json"); }
-void test_parse_object() { test_parse_value("../json/object.json"); }
+void test_parse_null() { test_parse_value("../json_file/null.json"); }
+void test_parse_false() { test_parse_value("../json_file/false.json"); }
+void test_parse_true() { test_parse_value("../json_file/true.json"); }
+void test_parse_number() { test_parse_value("../json_file/number.json"); }
+void test_parse_string() { test_parse_value("../json_file/string.json"); }
+void test_parse_array() { test_parse_value("../json_file/array.json"); }
+void test_parse_object() { test_parse_value("../json_file/object.json"); }
 
 void test() {
+    j4on_pool_init(&pool, J4ON_POOL_BLOCK_SIZE);
     test_parse_null();
     test_parse_false();
     test_parse_true();
@@ -25,6 +175,11 @@ void test() {
     test_parse_string();
     test_parse_array();
     test_parse_object();
+    test_zero_copy();
+    test_deep_nesting();
+    test_parse_error();
+    test_out_of_memory();
+    j4on_pool_destroy(&pool);
 }
 
 int main() { test(); }
\ No newline at end of file
@@ -0,0 +1,314 @@
+// Benchmarks of nextjson and j4on over JSON corpora.
+//
+// Build and run from cpp/:
+//   gcc -O2 -c ../c/j4on.c -o j4on.o
+//   g++ -std=c++17 -O2 -DNDEBUG -pthread bench.cpp j4on.o -o bench
+//   ./bench [file.json ...]
+//
+// Without arguments it runs over ../json_file/ and three generated corpora
+// shaped like the usual large ones: "twitter" (string heavy objects),
+// "canada" (deep arrays of numbers) and "citm" (wide objects, many keys).
+// Pass twitter.json, canada.json or citm_catalog.json to measure the real
+// files. Allocations count operator new, the Formatter buffer grows with
+// malloc and does not show. The peak RSS of a corpus is how far the
+// resident size rose above where it was when the corpus started, Linux
+// only.
+
+#include "json.h"
+
+extern "C" {
+#include "../c/j4on.h"
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace nextjson;
+
+static size_t allocs = 0;
+static size_t allocBytes = 0;
+
+void *operator new(size_t n) {
+    ++allocs;
+    allocBytes += n;
+    return std::malloc(n);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+struct Corpus {
+    std::string name;
+    std::string json;
+};
+
+// Run fn until it took 0.3s, at least 3 times, returns MB/s.
+static double throughput(size_t bytes, const std::function<void()> &fn) {
+    using clock = std::chrono::steady_clock;
+    size_t runs = 0;
+    double seconds = 0;
+    clock::time_point start = clock::now();
+    while (runs < 3 || seconds < 0.3) {
+        fn();
+        ++runs;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+    }
+    return bytes * runs / seconds / 1e6;
+}
+
+// Allocations of one call of fn.
+static void countAllocs(const std::function<void()> &fn, size_t &count,
+                        size_t &bytes) {
+    size_t before = allocs, beforeBytes = allocBytes;
+    fn();
+    count = allocs - before;
+    bytes = allocBytes - beforeBytes;
+}
+
+// Make the current resident size the new peak, false if the system cannot.
+static bool resetPeakRss() {
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (!file)
+        return false;
+    bool ok = fputs("5", file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+// Peak resident size in KB.
+static long peakRss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void report(const Corpus &corpus, const char *op, double mbps,
+                   const std::function<void()> &fn) {
+    size_t count, bytes;
+    countAllocs(fn, count, bytes);
+    printf("%-14s %-16s %10.1f MB/s %8zu allocs %10zu bytes\n",
+           corpus.name.c_str(), op, mbps, count, bytes);
+}
+
+static std::string twitterLike() {
+    std::string json = "{\"statuses\":[";
+    for (int i = 0; i < 3000; ++i) {
+        json += i ? "," : "";
+        json += "{\"id\":" + std::to_string(505874924095815681LL + i) +
+                ",\"text\":\"RT @user: \\u3053\\u3093\\u306b\\u3061\\u306f "
+                "a status update with some words in it #tag " +
+                std::to_string(i) +
+                "\",\"user\":{\"screen_name\":\"user" + std::to_string(i) +
+                "\",\"followers_count\":" + std::to_string(i * 37 % 5000) +
+                ",\"verified\":false,\"description\":\"line one\\nline two"
+                "\"},\"retweeted\":false,\"entities\":{\"hashtags\":[],"
+                "\"urls\":[\"https://example.com/" +
+                std::to_string(i) + "\"]}}";
+    }
+    return json + "]}";
+}
+
+static std::string canadaLike() {
+    std::string json = "{\"type\":\"FeatureCollection\",\"features\":[{"
+                       "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[";
+    char buf[64];
+    for (int ring = 0; ring < 100; ++ring) {
+        json += ring ? ",[" : "[";
+        for (int i = 0; i < 1000; ++i) {
+            snprintf(buf, sizeof(buf), "%s[-%.14f,%.14f]", i ? "," : "",
+                     65.0 + ring * 0.013 + i * 1e-5, 44.0 + i * 3.3e-6);
+            json += buf;
+        }
+        json += "]";
+    }
+    return json + "]}}]}";
+}
+
+static std::string citmLike() {
+    std::string json = "{\"events\":{";
+    for (int i = 0; i < 2000; ++i) {
+        std::string id = std::to_string(138586341 + i);
+        json += i ? "," : "";
+        json += "\"" + id + "\":{\"description\":null,\"id\":" + id +
+                ",\"logo\":\"/images/UE0AAAAACEKo6QAAAAZDSVRN\",\"name\":"
+                "\"Event " +
+                id + "\",\"subTopicIds\":[337184,337185],\"subjectCode\":"
+                     "null,\"subtitle\":null,\"topicIds\":[324846100,"
+                     "107888604]}";
+    }
+    json += "},\"areaNames\":{";
+    for (int i = 0; i < 200; ++i)
+        json += (i ? ",\"" : "\"") + std::to_string(205705993 + i) +
+                "\":\"Arrière-scène central " + std::to_string(i) + "\"";
+    return json + "}}";
+}
+
+static bool readFile(const char *path, std::string &out) {
+    FileStream input(path);
+    out.assign(input.data(), input.size());
+    return input.size() > 0;
+}
+
+// Every member of every object under value, for lookups.
+static void collectObjects(const Value &value,
+                           std::vector<const Object *> &objects) {
+    if (value.isArray()) {
+        const Array &arr = value.getArray();
+        for (size_t i = 0; i < arr.size(); ++i)
+            collectObjects(arr[i], objects);
+    } else if (value.isObject()) {
+        const Object &obj = value.getObject();
+        objects.push_back(&obj);
+        for (size_t i = 0; i < obj.size(); ++i)
+            collectObjects(obj[i].second, objects);
+    }
+}
+
+static void benchCorpus(const Corpus &corpus) {
+    const std::string &json = corpus.json;
+    size_t n = json.size();
+
+    report(corpus, "parse (cold)", throughput(n, [&] {
+               Document doc(json.data(), n);
+               doc.parse();
+           }),
+           [&] {
+               Document doc(json.data(), n);
+               doc.parse();
+           });
+
+    Document warm(json.data(), n);
+    warm.parse();
+    report(corpus, "parse (warm)", throughput(n, [&] {
+               warm.reset(json.data(), n);
+               warm.parse();
+           }),
+           [&] {
+               warm.reset(json.data(), n);
+               warm.parse();
+           });
+
+    ParseOptions zeroCopy;
+    zeroCopy.zeroCopy = true;
+    Document view(json.data(), n, zeroCopy);
+    view.parse();
+    report(corpus, "parse zero-copy", throughput(n, [&] {
+               view.reset(json.data(), n);
+               view.parse();
+           }),
+           [&] {
+               view.reset(json.data(), n);
+               view.parse();
+           });
+
+    struct Nothing : BaseHandler<Nothing> {};
+    Arena arena;
+    Parser sax(json.data(), n, &arena);
+    Nothing nothing;
+    sax.parse(nothing);
+    report(corpus, "parse sax", throughput(n, [&] { sax.parse(nothing); }),
+           [&] { sax.parse(nothing); });
+
+    FormatOptions compact;
+    compact.compact = true;
+    auto format = [&](const FormatOptions &options) {
+        Formatter formatter(options);
+        formatter.format(warm.root());
+        return formatter.size();
+    };
+    size_t compactSize = format(compact);
+    report(corpus, "format compact",
+           throughput(compactSize, [&] { format(compact); }),
+           [&] { format(compact); });
+    size_t prettySize = format(FormatOptions());
+    report(corpus, "format pretty",
+           throughput(prettySize, [&] { format(FormatOptions()); }),
+           [&] { format(FormatOptions()); });
+
+    // every key of every object looked up once.
+    std::vector<const Object *> objects;
+    collectObjects(warm.root(), objects);
+    size_t lookups = 0;
+    for (const Object *obj : objects)
+        lookups += obj->size();
+    if (lookups > 0) {
+        size_t found = 0;
+        auto lookup = [&] {
+            for (const Object *obj : objects)
+                for (size_t i = 0; i < obj->size(); ++i)
+                    found += obj->find((*obj)[i].first.getString().view()) !=
+                             nullptr;
+        };
+        using clock = std::chrono::steady_clock;
+        size_t runs = 0;
+        clock::time_point start = clock::now();
+        double seconds = 0;
+        while (runs < 3 || seconds < 0.3) {
+            lookup();
+            ++runs;
+            seconds =
+                std::chrono::duration<double>(clock::now() - start).count();
+        }
+        printf("%-14s %-16s %10.1f ns/lookup over %zu objects\n",
+               corpus.name.c_str(), "object lookup",
+               seconds * 1e9 / (runs * lookups), objects.size());
+    }
+
+    // j4on moves json->content along, so it parses a private copy.
+    std::vector<char> content(json.begin(), json.end());
+    content.push_back('\0');
+    struct j4on_pool pool;
+    j4on_pool_init(&pool, J4ON_POOL_BLOCK_SIZE);
+    auto j4on = [&] {
+        struct json c = {};
+        c.content = content.data();
+        struct slist list;
+        slist_init(&list);
+        j4on_pool_reset(&pool);
+        j4on_parse(&list, &c, &pool);
+    };
+    double mbps = throughput(n, j4on);
+    printf("%-14s %-16s %10.1f MB/s\n", corpus.name.c_str(), "j4on_parse",
+           mbps);
+    j4on_pool_destroy(&pool);
+}
+
+int main(int argc, char **argv) {
+    std::vector<Corpus> corpora;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            Corpus corpus{argv[i], ""};
+            if (!readFile(argv[i], corpus.json)) {
+                fprintf(stderr, "can not read %s\n", argv[i]);
+                return 1;
+            }
+            corpora.push_back(corpus);
+        }
+    } else {
+        const char *samples[] = {"array",  "false",  "null",  "number",
+                                 "object", "string", "true"};
+        for (const char *sample : samples) {
+            Corpus corpus{sample, ""};
+            std::string path = std::string("../json_file/") + sample + ".json";
+            if (readFile(path.c_str(), corpus.json))
+                corpora.push_back(corpus);
+        }
+        corpora.push_back(Corpus{"twitter*", twitterLike()});
+        corpora.push_back(Corpus{"canada*", canadaLike()});
+        corpora.push_back(Corpus{"citm*", citmLike()});
+    }
+
+    for (const Corpus &corpus : corpora) {
+        printf("%s: %zu bytes\n", corpus.name.c_str(), corpus.json.size());
+        bool reset = resetPeakRss();
+        long before = peakRss();
+        benchCorpus(corpus);
+        if (reset)
+            printf("%-14s peak rss +%ld KB\n", corpus.name.c_str(),
+                   peakRss() - before);
+    }
+}
@@ -12,12 +12,77 @@
 #include <string>
 #include <vector>
 #include <fstream>
-#include <any>
 #include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <cassert>
 #include <cerrno>
 #include <cmath>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NEXTJSON_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define NEXTJSON_POSIX 0
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NEXTJSON_X86 1
+#include <immintrin.h>
+#else
+#define NEXTJSON_X86 0
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define NEXTJSON_NEON 1
+#include <arm_neon.h>
+#else
+#define NEXTJSON_NEON 0
+#endif
+
+// Keeps a rarely taken path out of the loop that calls it.
+#if defined(__GNUC__)
+#define NEXTJSON_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define NEXTJSON_NOINLINE __declspec(noinline)
+#else
+#define NEXTJSON_NOINLINE
+#endif
+
+// The counters of ParseStats, built with -DNEXTJSON_STATS=1 only. Without
+// it the counting statements are compiled out.
+#ifndef NEXTJSON_STATS
+#define NEXTJSON_STATS 0
+#endif
+#if NEXTJSON_STATS
+#define NEXTJSON_STAT(...) __VA_ARGS__
+#else
+#define NEXTJSON_STAT(...)
+#endif
 
 // JSON structure as follows.
 
@@ -68,522 +133,6201 @@ static const char *ValueTypeName[8] = {"unknown", "null",   "false", "true",
 /// Stringify value type \p type .
 inline const char *typeToString(ValueType type) { return ValueTypeName[type]; }
 
-/// Universal Value structure.
-/// A \c Value object hold \c type_ and the any type value \c value_ .
-class Value {
-  public:
-    Value() : type_(kUnknown) {}
-    Value(ValueType type, const std::any &value) : type_(type), value_(value) {}
-    ValueType type() const { return type_; }
-    const std::any &getAnyValue() const { return value_; }
-    void setAnyValue(const std::any &value) { value_ = value; }
+/// Where parsing and formatting time goes, counted when built with
+/// NEXTJSON_STATS and all zero otherwise. Times are in nanoseconds.
+struct ParseStats {
+    uint64_t bytesScanned = 0;
+    uint64_t nodes[8] = {};         // values built, by ValueType.
+    uint64_t stringBytesCopied = 0; // copied or decoded into the arena.
+    uint64_t stringBytesViewed = 0; // left in the input by zero copy.
+    uint64_t arenaBlocks = 0;       // taken from the system allocator.
+    uint64_t maxDepth = 0;
+    uint64_t scanNanos = 0;  // structural index.
+    uint64_t buildNanos = 0; // values from the index.
+    uint64_t formatNanos = 0;
 
-  private:
-    ValueType type_;
-    std::any value_;
+    /// Sum with \p other , the deepest of both depths.
+    void add(const ParseStats &other) {
+        bytesScanned += other.bytesScanned;
+        for (int i = 0; i < 8; ++i)
+            nodes[i] += other.nodes[i];
+        stringBytesCopied += other.stringBytesCopied;
+        stringBytesViewed += other.stringBytesViewed;
+        arenaBlocks += other.arenaBlocks;
+        maxDepth = std::max(maxDepth, other.maxDepth);
+        scanNanos += other.scanNanos;
+        buildNanos += other.buildNanos;
+        formatNanos += other.formatNanos;
+    }
+
+    /// Totals of every \c Document of the calling thread.
+    static ParseStats &thread() {
+        thread_local ParseStats stats;
+        return stats;
+    }
 };
 
-/// Literal value. e.g. null, false, true.
-class Literal {
+namespace detail {
+
+inline uint64_t statClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace detail
+
+/// Monotonic allocator backing a whole value tree.
+/// Memory is carved out of large blocks and never freed one by one. The
+/// arena is released in one shot by \c reset() , which keeps the blocks for
+/// the next use, or by the destructor.
+class Arena {
   public:
-    explicit Literal(const char *liteal, size_t n) : literal_(liteal, n) {}
-    const std::string &getLiteral() const { return literal_; };
+    static constexpr size_t kDefaultBlockSize = 4 * 1024;
+    static constexpr size_t kMaxBlockSize = 1024 * 1024;
+
+    explicit Arena(size_t blockSize = kDefaultBlockSize)
+        : nextBlockSize_(blockSize),
+          head_(nullptr),
+          current_(nullptr),
+          ptr_(0),
+          end_(0),
+          blocks_(0) {}
+    ~Arena() { release(); }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t n, size_t align = alignof(std::max_align_t)) {
+        uintptr_t p = (ptr_ + align - 1) & ~(uintptr_t(align) - 1);
+        // p can pass end_ after rounding, end_ - p would then wrap.
+        if (current_ == nullptr || p > end_ || n > end_ - p)
+            return allocateSlow(n, align);
+        ptr_ = p + n;
+        return reinterpret_cast<void *>(p);
+    }
+
+    template <typename T, typename... Args> T *create(Args &&...args) {
+        return new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+    }
+
+    /// Copy \p n characters of \p str , the copy is NUL-terminated.
+    char *copy(const char *str, size_t n) {
+        char *p = static_cast<char *>(allocate(n + 1, 1));
+        std::copy(str, str + n, p);
+        p[n] = '\0';
+        return p;
+    }
+
+    /// Lock free allocation for caches built by concurrent readers, the
+    /// memory is 16 bytes aligned and freed on \c reset() . The other
+    /// members are not thread safe.
+    void *allocateShared(size_t n) {
+        n = (n + 15) & ~size_t(15);
+        SharedBlock *block = shared_.load(std::memory_order_acquire);
+        for (;;) {
+            if (block) {
+                size_t offset = block->used.fetch_add(n);
+                if (offset + n <= block->size)
+                    return block->data() + offset;
+            }
+            size_t size = std::max(kDefaultBlockSize, n);
+            SharedBlock *fresh = static_cast<SharedBlock *>(
+                std::malloc(sizeof(SharedBlock) + size));
+            fresh->next = block;
+            fresh->size = size;
+            new (&fresh->used) std::atomic<size_t>(n);
+            if (shared_.compare_exchange_strong(block, fresh,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire))
+                return fresh->data();
+            std::free(fresh);
+        }
+    }
+
+    /// Rewind to the first block, all blocks are kept for reuse.
+    void reset() {
+        current_ = head_;
+        if (current_)
+            use(current_);
+        releaseShared();
+    }
+
+    /// Give all blocks back to the system allocator.
+    void release() {
+        while (head_) {
+            Block *next = head_->next;
+            std::free(head_);
+            head_ = next;
+        }
+        current_ = nullptr;
+        ptr_ = end_ = 0;
+        releaseShared();
+    }
+
+    /// Blocks taken from the system allocator so far, counted with
+    /// NEXTJSON_STATS only.
+    size_t blocks() const { return blocks_; }
+
+    /// Total bytes held in blocks, those of \c allocateShared() included.
+    size_t capacity() const {
+        size_t n = 0;
+        for (Block *b = head_; b; b = b->next)
+            n += b->size;
+        for (SharedBlock *b = shared_.load(std::memory_order_acquire); b;
+             b = b->next)
+            n += b->size;
+        return n;
+    }
 
   private:
-    std::string literal_;
+    struct Block {
+        Block *next;
+        size_t size;
+        char *data() { return reinterpret_cast<char *>(this + 1); }
+    };
+
+    struct alignas(16) SharedBlock {
+        SharedBlock *next;
+        size_t size;
+        std::atomic<size_t> used;
+        char *data() { return reinterpret_cast<char *>(this + 1); }
+    };
+
+    void releaseShared() {
+        SharedBlock *block = shared_.exchange(nullptr);
+        while (block) {
+            SharedBlock *next = block->next;
+            std::free(block);
+            block = next;
+        }
+    }
+
+    void use(Block *block) {
+        current_ = block;
+        ptr_ = reinterpret_cast<uintptr_t>(block->data());
+        end_ = ptr_ + block->size;
+    }
+
+    void *allocateSlow(size_t n, size_t align) {
+        // blocks kept by reset() first.
+        while (current_ && current_->next) {
+            use(current_->next);
+            uintptr_t p = (ptr_ + align - 1) & ~(uintptr_t(align) - 1);
+            if (p <= end_ && n <= end_ - p)
+                return allocate(n, align);
+        }
+
+        size_t size = std::max(nextBlockSize_, n + align);
+        nextBlockSize_ = std::min(nextBlockSize_ * 2, kMaxBlockSize);
+        Block *block = static_cast<Block *>(std::malloc(sizeof(Block) + size));
+        NEXTJSON_STAT(++blocks_);
+        block->next = nullptr;
+        block->size = size;
+        if (current_)
+            current_->next = block;
+        else
+            head_ = block;
+        use(block);
+        return allocate(n, align);
+    }
+
+    size_t nextBlockSize_;
+    Block *head_;
+    Block *current_;
+    uintptr_t ptr_;
+    uintptr_t end_;
+    size_t blocks_;
+    std::atomic<SharedBlock *> shared_{nullptr};
 };
 
+class Array;
+class Object;
+
+namespace detail {
+class TreeBuilder;
+class Patcher;
+} // namespace detail
+
 /// Number value.
+/// Integers are held exactly as int64 or, above INT64_MAX, as uint64, so
+/// large IDs survive a round trip.
 class Number {
   public:
-    Number(double number) : number_(number) {}
-    double getNumber() const { return number_; }
+    enum Type : uint8_t { kDouble, kInt64, kUint64 };
+
+    Number(double number) : type_(kDouble) { double_ = number; }
+    template <typename T,
+              typename = std::enable_if_t<std::is_integral_v<T> &&
+                                          !std::is_same_v<T, bool>>>
+    Number(T number) {
+        if (std::is_signed_v<T> || uint64_t(number) <= INT64_MAX) {
+            type_ = kInt64;
+            int64_ = static_cast<int64_t>(number);
+        } else {
+            type_ = kUint64;
+            uint64_ = static_cast<uint64_t>(number);
+        }
+    }
+
+    Type type() const { return type_; }
+    bool isDouble() const { return type_ == kDouble; }
+    bool isInt64() const { return type_ == kInt64; }
+    bool isUint64() const { return type_ == kUint64; }
+
+    /// The number as a double, integers may lose precision.
+    double getNumber() const {
+        switch (type_) {
+        case kInt64:
+            return static_cast<double>(int64_);
+        case kUint64:
+            return static_cast<double>(uint64_);
+        default:
+            return double_;
+        }
+    }
+    int64_t getInt64() const {
+        assert(isInt64());
+        return int64_;
+    }
+    uint64_t getUint64() const {
+        assert(isUint64());
+        return uint64_;
+    }
 
   private:
-    double number_;
+    friend class Value;
+
+    union {
+        double double_;
+        int64_t int64_;
+        uint64_t uint64_;
+    };
+    Type type_;
 };
 
 /// String value.
+/// A view of characters owned by a \c Value or an \c Arena , it is only
+/// valid as long as the owner.
 class String {
   public:
-    explicit String(std::string str) : str_(str) {}
-    String(const char *str, size_t n) : str_(str, n) {}
-    std::string getString() const { return str_; }
+    String(const char *str, size_t n) : str_(str), size_(n) {}
+    String(const char *str)
+        : String(str, std::char_traits<char>::length(str)) {}
+    explicit String(const std::string &str) : String(str.data(), str.size()) {}
+
+    const char *data() const { return str_; }
+    size_t size() const { return size_; }
+    std::string_view view() const { return std::string_view(str_, size_); }
+    std::string getString() const { return std::string(str_, size_); }
 
   private:
-    std::string str_; // should be std::string not std::string_view
+    const char *str_;
+    size_t size_;
 };
 
-/// Array value.
-class Array {
-  public:
-    Array() {}
-    Value operator[](size_t index) const { return values_[index]; }
-    void add(Value v) { values_.push_back(v); }
-    size_t size() const { return values_.size(); }
+namespace detail {
 
-  private:
-    std::vector<Value> values_;
+inline size_t encodeUtf8(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = static_cast<char>(cp);
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = static_cast<char>(0xC0 | (cp >> 6));
+        out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = static_cast<char>(0xE0 | (cp >> 12));
+        out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | (cp >> 18));
+    out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Value of each hex digit, -1 for any other byte.
+struct HexTable {
+    int8_t digit[256];
+
+    constexpr HexTable() : digit() {
+        for (int i = 0; i < 256; ++i)
+            digit[i] = -1;
+        for (int i = 0; i < 10; ++i)
+            digit['0' + i] = static_cast<int8_t>(i);
+        for (int i = 0; i < 6; ++i)
+            digit['a' + i] = digit['A' + i] = static_cast<int8_t>(10 + i);
+    }
 };
 
-/// Object value.
-class Object {
-  public:
-    using member_t = std::pair<std::string, Value>;
+inline constexpr HexTable kHex{};
 
-    Object() {}
-    Object(const member_t &member) : memberList_{member} {}
+// Four table lookups, a bad digit sets the high bits of the result.
+inline bool parseHex4(const char *p, uint32_t &cp) {
+    auto digit = [&](int i) {
+        return static_cast<uint32_t>(kHex.digit[static_cast<uint8_t>(p[i])]);
+    };
+    cp = digit(0) << 12 | digit(1) << 8 | digit(2) << 4 | digit(3);
+    return cp <= 0xffff;
+}
 
-    const member_t &operator[](size_t index) const {
-        return memberList_[index];
-    }
+// What each character after a backslash decodes to, 0 if it is not an
+// escape. 'u' stands for itself and is decoded apart.
+struct EscapeTable {
+    char decoded[256];
 
-    // O(n)
-    Value operator[](std::string &key) const {
-        for (auto member : memberList_)
-            if (key == member.first)
-                return member.second;
-        return Value();
+    constexpr EscapeTable() : decoded() {
+        decoded[int('\"')] = '\"';
+        decoded[int('\\')] = '\\';
+        decoded[int('/')] = '/';
+        decoded[int('b')] = '\b';
+        decoded[int('f')] = '\f';
+        decoded[int('n')] = '\n';
+        decoded[int('r')] = '\r';
+        decoded[int('t')] = '\t';
+        decoded[int('u')] = 'u';
     }
+};
 
-    void add(const member_t &member) { memberList_.push_back(member); }
+inline constexpr EscapeTable kEscape{};
 
-    size_t size() const { return memberList_.size(); }
+/// First malformed escape of the raw string body \p raw of \p n bytes,
+/// nullptr if there is none. Only backslashes are visited. A lone
+/// surrogate is well formed, it decodes to U+FFFD.
+inline const char *invalidEscape(const char *raw, size_t n) {
+    const char *end = raw + n;
+    for (const char *p = raw;; p += 2) {
+        p = static_cast<const char *>(std::memchr(p, '\\', end - p));
+        if (!p)
+            return nullptr;
+        char ch = p + 1 < end ? kEscape.decoded[uint8_t(p[1])] : 0;
+        uint32_t cp;
+        if (ch == 0 || (ch == 'u' && (end - p < 6 || !parseHex4(p + 2, cp))))
+            return p;
+        if (ch == 'u')
+            p += 4;
+        if (p + 2 >= end)
+            return nullptr;
+    }
+}
 
-  private:
-    // <key, value>, use std::vector keep JSON order.
-    std::vector<member_t> memberList_;
-};
+/// Decode the escapes of the raw string body \p raw into \p out , which
+/// needs room for \p n characters. Returns the decoded length. Runs
+/// without escapes are copied whole, a malformed escape is kept as it is.
+inline size_t unescape(const char *raw, size_t n, char *out) {
+    const char *end = raw + n;
+    char *q = out;
+    for (const char *p = raw; p < end;) {
+        const char *slash =
+            static_cast<const char *>(std::memchr(p, '\\', end - p));
+        const char *stop = slash ? slash : end;
+        std::memcpy(q, p, stop - p);
+        q += stop - p;
+        p = stop;
+        if (p == end || ++p == end)
+            break;
 
-class FileStream {
-  public:
-    FileStream(const char *filename) : filename_(filename) {
-        std::ifstream input(filename, std::ios::binary);
-        std::vector<char> filedata((std::istreambuf_iterator<char>(input)),
-                                   std::istreambuf_iterator<char>());
-        std::swap(filedata, content_);
+        char ch = *p++;
+        char decoded = kEscape.decoded[static_cast<uint8_t>(ch)];
+        switch (decoded) {
+        case 0:
+            *q++ = ch;
+            break;
+        case 'u': {
+            uint32_t cp, lo;
+            if (end - p < 4 || !parseHex4(p, cp)) {
+                *q++ = ch;
+                break;
+            }
+            p += 4;
+            // surrogate pair, a lone surrogate becomes U+FFFD.
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                if (end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                    parseHex4(p + 2, lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    p += 6;
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                cp = 0xFFFD;
+            }
+            q += encodeUtf8(cp, q);
+            break;
+        }
+        default:
+            *q++ = decoded;
+        }
     }
+    return q - out;
+}
 
-    const char *data() const { return content_.data(); }
-    size_t size() const { return content_.size(); }
+/// Escaped string kept in its raw form until it is first read, then
+/// decoded into \c arena .
+struct LazyString {
+    LazyString(const char *raw, size_t rawSize, Arena *arena)
+        : raw(raw), rawSize(rawSize), arena(arena), str(nullptr), size(0) {}
 
-  private:
-    const char *filename_;
-    std::vector<char> content_;
+    // Readers racing on the first get() decode the same characters, the
+    // first copy published wins.
+    String get() const {
+        const char *decoded = str.load(std::memory_order_acquire);
+        if (!decoded) {
+            char *p = static_cast<char *>(arena->allocateShared(rawSize + 1));
+            size_t n = unescape(raw, rawSize, p);
+            p[n] = '\0';
+            size.store(n, std::memory_order_relaxed);
+            if (str.compare_exchange_strong(decoded, p,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire))
+                decoded = p;
+        }
+        return String(decoded, size.load(std::memory_order_relaxed));
+    }
+
+    const char *raw;
+    size_t rawSize;
+    Arena *arena;
+    mutable std::atomic<const char *> str;
+    mutable std::atomic<size_t> size; // every decode stores the same size.
 };
 
-/// Wrapper of std::vector<char>
-template <size_t N = 64> class Buffer {
+} // namespace detail
+
+/// Universal Value structure.
+/// A \c Value is a 16 bytes tagged union keyed on \c ValueType . Literals
+/// only need the tag, numbers are stored inline, the characters of a string
+/// and the \c Array or \c Object are held by pointer.
+/// A heap payload is owned by the \c Value , a payload carved from an
+/// \c Arena belongs to the arena and is never freed by the \c Value .
+/// Heap arrays and objects are reference counted: copying shares them and
+/// the non-const accessors copy a shared container before handing it out,
+/// so editing a copy only copies the path to the edit. A reference from a
+/// non-const accessor must not be used after the value is copied.
+class Value {
   public:
-    Buffer()
-        : size_(0),
-          capacity_(N - sizeof(size_t) * 2 - sizeof(char *)),
-          ptr_(nullptr) {
-        static_assert(N != 0 && ((N & (N - 1)) == 0), "Not Power of 2");
+    Value() : size_(0), flags_(0), type_(kUnknown) { number_ = 0; }
+    explicit Value(ValueType literal) : size_(0), flags_(0), type_(literal) {
+        assert(literal <= kTrue);
+        number_ = 0;
     }
-
-    ~Buffer() {
-        if (ptr_)
-            std::free(ptr_);
+    Value(Number number)
+        : size_(0), flags_(number.type_ << kNumberShift), type_(kNumber) {
+        uint64_ = number.uint64_;
     }
-    Buffer(const Buffer &) = delete;
-    Buffer &operator=(const Buffer &) = delete;
-
-    size_t size() const { return size_; }
-    size_t capacity() const { return capacity_; }
-    char *begin() { return ptr_ ? ptr_ : data_; }
-    char *end() { return begin() + size_; }
-    const char *data() const { return ptr_ ? ptr_ : data_; }
+    Value(double number) : Value(Number(number)) {}
+    template <typename T,
+              typename = std::enable_if_t<std::is_integral_v<T> &&
+                                          !std::is_same_v<T, bool>>>
+    Value(T number) : Value(Number(number)) {}
+    /// Copy \p str into \p arena , or into the heap when \p arena is null.
+    Value(const String &str, Arena *arena = nullptr);
+    Value(const Array &array);
+    Value(Array &&array);
+    Value(const Object &obj);
+    Value(Object &&obj);
 
-    void append(const char *data, size_t n) {
-        grow(n);
-        std::copy(data, data + n, end());
-        size_ += n;
+    /// Deep copy \p rhs into \p arena , or into the heap when \p arena is
+    /// null.
+    Value(const Value &rhs, Arena *arena);
+    Value(const Value &rhs) : Value(rhs, nullptr) {}
+    Value(Value &&rhs) noexcept
+        : size_(rhs.size_), flags_(rhs.flags_), type_(rhs.type_) {
+        ptr_ = rhs.ptr_;
+        rhs.flags_ = 0;
+        rhs.type_ = kUnknown;
     }
-
-    void append(const char *data) {
-        append(data, std::char_traits<char>::length(data));
+    Value &operator=(Value rhs) noexcept {
+        swap(rhs);
+        return *this;
     }
-    void append(const std::string &str) { append(str.data(), str.length()); }
-    void append(char ch) { append(&ch, 1); }
-
-  private:
-    void grow(size_t n) {
-        size_t newSize = size_ + n;
-        if (newSize < capacity_)
-            return;
+    ~Value() { destroy(); }
 
-        // grow witg 1.5 size.
-        capacity_ = std::max(newSize, capacity_ + (capacity_ + 1) / 2);
-        char *p = static_cast<char *>(std::malloc(capacity_));
-        std::copy(data(), data() + size_, p);
-        std::swap(p, ptr_);
-        std::free(p);
+    void swap(Value &rhs) noexcept {
+        std::swap(ptr_, rhs.ptr_);
+        std::swap(size_, rhs.size_);
+        std::swap(flags_, rhs.flags_);
+        std::swap(type_, rhs.type_);
     }
 
-    size_t size_;
-    size_t capacity_;
-    char *ptr_;
-    char data_[N - sizeof(size_t) * 2 - sizeof(char *)];
-};
+    ValueType type() const { return type_; }
+    bool isNull() const { return type_ == kNull; }
+    bool isBool() const { return type_ == kFalse || type_ == kTrue; }
+    bool isNumber() const { return type_ == kNumber; }
+    bool isString() const { return type_ == kString; }
+    bool isArray() const { return type_ == kArray; }
+    bool isObject() const { return type_ == kObject; }
 
-using SmallBuffer = Buffer<64>;
-using MeduimBuffer = Buffer<256>;
-using LargeBuffer = Buffer<1024>;
+    /// Payload lives on the heap and is freed with this value.
+    bool isOwned() const { return flags_ & kOwned; }
 
-class Formatter {
-  public:
-    const char *data() const { return buffer_.data(); }
-    size_t size() const { return buffer_.size(); }
-    void format(const Value &root) { formatValue(root, 0); }
+    /// Heap array or object also held by other values.
+    bool isShared() const;
 
-  private:
-    void formatIndent(uint32_t depth) {
-        for (uint32_t i = 0; i < depth; ++i)
-            buffer_.append('\t');
+    // Typed accessors, the caller must check type() first.
+    bool getBool() const {
+        assert(isBool());
+        return type_ == kTrue;
     }
-
-    void formatValue(const Value &value, uint32_t depth) {
-        switch (value.type()) {
-        case kNull:
-        case kFalse:
-        case kTrue:
-            return formatLiteral(value, depth);
-        case kNumber:
-            return formatNumber(value, depth);
-        case kString:
-            return formatString(value, depth);
-        case kArray:
-            return formatArray(value, depth);
-        case kObject:
-            return formatObject(value, depth);
-        case kUnknown:
-            return; /* do nothing. */
+    Number getNumber() const {
+        assert(isNumber());
+        switch (flags_ >> kNumberShift) {
+        case Number::kInt64:
+            return Number(int64_);
+        case Number::kUint64:
+            return Number(uint64_);
+        default:
+            return Number(number_);
         }
     }
-    void formatLiteral(const Value &value, uint32_t depth) {
-        Literal literal = std::any_cast<Literal>(value.getAnyValue());
-        buffer_.append(literal.getLiteral());
+    String getString() const {
+        assert(isString());
+        if (flags_ & kEscaped)
+            return lazy_->get();
+        return String(str_, size_);
     }
-    void formatNumber(const Value &value, uint32_t depth) {
-        Number number = std::any_cast<Number>(value.getAnyValue());
-        // replace std::to_string with snprintf("%.g");
-        // in some case. eg: 1e-09, the result will be 0.0000.
-        // better performance could use Grisu2/3 algorithm.
-        char buf[12];
-        snprintf(buf, sizeof(buf), "%.12g", number.getNumber());
-        buffer_.append(buf);
+    const Array &getArray() const {
+        assert(isArray());
+        return *array_;
     }
-    void formatString(const Value &value, uint32_t depth) {
-        String str = std::any_cast<String>(value.getAnyValue());
-        buffer_.append('\"');
-        buffer_.append(str.getString());
-        buffer_.append('\"');
+    Array &getArray() {
+        assert(isArray());
+        if (isOwned())
+            detach();
+        return *array_;
+    }
+    const Object &getObject() const {
+        assert(isObject());
+        return *object_;
+    }
+    Object &getObject() {
+        assert(isObject());
+        if (isOwned())
+            detach();
+        return *object_;
     }
-    void formatArray(const Value &value, uint32_t depth) {
-        Array arr = std::any_cast<Array>(value.getAnyValue());
 
-        buffer_.append('[');
-        if (arr.size() > 0)
-            buffer_.append('\n');
+  private:
+    friend class detail::TreeBuilder;
+    friend class Formatter;
+    friend class BinaryValue;
+    friend class BinaryWriter;
 
-        Value v;
-        for (size_t i = 0; i < arr.size(); ++i) {
-            v = arr[i];
-            formatIndent(depth + 1);
+    enum Flag : uint8_t {
+        kOwned = 1,    // payload is on the heap.
+        kEscaped = 2,  // string is a detail::LazyString .
+        kVerbatim = 4, // string characters are also its JSON source.
+        kNumberShift = 3, // Number::Type of a number.
+    };
 
-            formatValue(v, depth + 1);
+    // Arena or input payload, not owned.
+    Value(const char *str, size_t n, uint8_t flags)
+        : size_(static_cast<uint32_t>(n)), flags_(flags), type_(kString) {
+        assert(n <= UINT32_MAX);
+        str_ = str;
+    }
+    Value(detail::LazyString *str)
+        : size_(0), flags_(kEscaped | kVerbatim), type_(kString) {
+        lazy_ = str;
+    }
+    Value(Array *array) : size_(0), flags_(0), type_(kArray) {
+        array_ = array;
+    }
+    Value(Object *obj) : size_(0), flags_(0), type_(kObject) {
+        object_ = obj;
+    }
 
-            if (i != arr.size() - 1) // last element.
-                buffer_.append(",\n", 2);
-            else
-                buffer_.append('\n');
-        }
+    static const char *copyChars(const char *str, size_t n, Arena *arena) {
+        if (arena)
+            return arena->copy(str, n);
+        char *p = static_cast<char *>(std::malloc(n + 1));
+        std::copy(str, str + n, p);
+        p[n] = '\0';
+        return p;
+    }
 
-        if (arr.size() > 0)
-            formatIndent(depth);
-        buffer_.append(']');
+    // JSON source form of a parsed string, data() is null if unknown.
+    String getRawString() const {
+        if (flags_ & kEscaped)
+            return String(lazy_->raw, lazy_->rawSize);
+        if (flags_ & kVerbatim)
+            return String(str_, size_);
+        return String(nullptr, 0);
     }
-    void formatObject(const Value &value, uint32_t depth) {
-        Object obj = std::any_cast<Object>(value.getAnyValue());
 
-        buffer_.append('{');
-        if (obj.size() > 0)
-            buffer_.append('\n');
+    void destroy();
+    // Make a shared heap container private to this value.
+    void detach();
+    template <typename T> static T *share(T *container) {
+        container->refs_.fetch_add(1, std::memory_order_relaxed);
+        return container;
+    }
 
-        Value v;
-        std::pair<std::string, Value> member;
-        for (size_t i = 0; i < obj.size(); ++i) {
-            member = obj[i];
+    union {
+        double number_;
+        int64_t int64_;
+        uint64_t uint64_;
+        void *ptr_;
+        const char *str_;
+        detail::LazyString *lazy_;
+        Array *array_;
+        Object *object_;
+    };
+    uint32_t size_; // string length.
+    uint8_t flags_;
+    ValueType type_;
+};
 
-            // print key
-            formatIndent(depth + 1);
-            buffer_.append('\"');
-            buffer_.append(member.first);
-            buffer_.append("\":", 2);
+static_assert(sizeof(Value) == 16, "Value should be kept in 16 bytes");
 
-            // value.
-            formatValue(member.second, depth + 1);
+namespace detail {
 
-            // last element.
-            if (i != obj.size() - 1)
-                buffer_.append(",\n", 2);
-            else
-                buffer_.append('\n');
-        }
+// Deep copy into arena, or into the heap when arena is null.
+inline void copyConstruct(Value *p, const Value &v, Arena *arena) {
+    new (p) Value(v, arena);
+}
+inline void copyConstruct(std::pair<Value, Value> *p,
+                          const std::pair<Value, Value> &v, Arena *arena) {
+    new (p) std::pair<Value, Value>(Value(v.first, arena),
+                                    Value(v.second, arena));
+}
 
-        if (obj.size() > 0)
-            formatIndent(depth);
-        buffer_.append('}');
+// Hash of an object key, a word at a time.
+inline uint32_t hashKey(const char *p, size_t n) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
     }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p, n);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+    return static_cast<uint32_t>(h ^ (h >> 29));
+}
 
-    MeduimBuffer buffer_;
-};
+// Keep \p v as is unless it is a heap value going into an arena.
+inline Value adopt(Value &&v, Arena *arena) {
+    if (arena && v.isOwned())
+        return Value(v, arena);
+    return std::move(v);
+}
 
-class Parser {
+/// Growable list of \p T , the storage is carved from an \c Arena or
+/// malloc'ed when arena is null.
+template <typename T> class List {
   public:
-    Parser(const char *data, size_t n) : token_(0), view_(data, n) {}
+    explicit List(Arena *arena)
+        : data_(nullptr), size_(0), capacity_(0), arena_(arena) {}
+    List(const List &rhs, Arena *arena) : List(arena) {
+        reserve(rhs.size_);
+        for (; size_ < rhs.size_; ++size_)
+            copyConstruct(data_ + size_, rhs.data_[size_], arena);
+    }
+    List(List &&rhs) noexcept
+        : data_(rhs.data_),
+          size_(rhs.size_),
+          capacity_(rhs.capacity_),
+          arena_(rhs.arena_) {
+        rhs.data_ = nullptr;
+        rhs.size_ = rhs.capacity_ = 0;
+    }
+    List &operator=(const List &) = delete;
+    ~List() {
+        for (size_t i = 0; i < size_; ++i)
+            data_[i].~T();
+        if (!arena_)
+            std::free(data_);
+    }
 
-    // Parse element.
-    Value parse() {
-        if (view_.size() == 0)
-            return Value();
-        Value value = parseElement();
-        assert(view_.size() == token_);
-        return value;
+    void swap(List &rhs) noexcept {
+        std::swap(data_, rhs.data_);
+        std::swap(size_, rhs.size_);
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(arena_, rhs.arena_);
     }
 
-  private:
-    size_t token_;
-    std::string_view view_;
+    T &operator[](size_t index) { return data_[index]; }
+    const T &operator[](size_t index) const { return data_[index]; }
+    T *begin() { return data_; }
+    T *end() { return data_ + size_; }
+    const T *begin() const { return data_; }
+    const T *end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    Arena *arena() const { return arena_; }
 
-    size_t length() const { return view_.size(); }
-    const char *token() const { return view_.begin() + token_; }
-    char peek() const { return *token(); }
-    char next() { return *(view_.begin() + token_++); }
+    void push_back(T &&v) {
+        if (size_ == capacity_)
+            reserve(capacity_ ? capacity_ * 2 : 4);
+        new (data_ + size_++) T(std::move(v));
+    }
 
-    void parseWhitespace() {
-        char ch = peek();
-        if (ch == ' ' || ch == '\r' || ch == '\n' || ch == '\t')
-            next();
-        else
+    // Move \p v in before the item at \p index , the rest move up one.
+    void insert(size_t index, T &&v) {
+        assert(index <= size_);
+        if (size_ == capacity_)
+            reserve(capacity_ ? capacity_ * 2 : 4);
+        if (index == size_) {
+            new (data_ + size_++) T(std::move(v));
             return;
-        parseWhitespace();
+        }
+        new (data_ + size_) T(std::move(data_[size_ - 1]));
+        for (size_t i = size_ - 1; i > index; --i)
+            data_[i] = std::move(data_[i - 1]);
+        data_[index] = std::move(v);
+        ++size_;
     }
 
-    // ws value ws
-    Value parseElement() {
-        parseWhitespace();
-        Value value = parseValue();
-        parseWhitespace();
+    // Drop the item at \p index , the rest move down one.
+    void erase(size_t index) {
+        assert(index < size_);
+        for (size_t i = index; i + 1 < size_; ++i)
+            data_[i] = std::move(data_[i + 1]);
+        data_[--size_].~T();
+    }
 
-        return value;
+    // Move \p n items from \p first into exactly sized storage.
+    void assign(T *first, size_t n) {
+        assert(size_ == 0);
+        reserve(n);
+        for (; size_ < n; ++size_)
+            new (data_ + size_) T(std::move(first[size_]));
     }
 
-    // element ',' elements
-    void parseElements(Array &array) {
-        Value value = parseElement();
-        array.add(value);
-        if (peek() == ',') {
-            next();
-            parseElements(array);
+    void reserve(size_t n) {
+        if (n <= capacity_)
+            return;
+        assert(n <= UINT32_MAX);
+        T *p = static_cast<T *>(
+            arena_ ? arena_->allocate(sizeof(T) * n, alignof(T))
+                   : std::malloc(sizeof(T) * n));
+        for (size_t i = 0; i < size_; ++i) {
+            new (p + i) T(std::move(data_[i]));
+            data_[i].~T();
         }
+        if (!arena_)
+            std::free(data_);
+        data_ = p;
+        capacity_ = static_cast<uint32_t>(n);
     }
 
-    // ws string ws ':' element
-    std::pair<std::string, Value> parseMember() {
-        parseWhitespace();
-        Value key = parseString();
-        parseWhitespace();
+  private:
+    T *data_;
+    uint32_t size_;
+    uint32_t capacity_;
+    Arena *arena_;
+};
 
-        assert(next() == ':');
+} // namespace detail
 
-        Value value = parseElement();
+/// Array value.
+class Array {
+  public:
+    explicit Array(Arena *arena = nullptr) : values_(arena) {}
+    Array(const Array &rhs, Arena *arena = nullptr)
+        : values_(rhs.values_, arena) {}
+    Array(Array &&rhs) noexcept : values_(std::move(rhs.values_)) {}
+    Array &operator=(Array rhs) noexcept {
+        values_.swap(rhs.values_);
+        return *this;
+    }
 
-        String keyValue = std::any_cast<String>(key.getAnyValue());
-        std::string keystr = keyValue.getString();
-        std::pair<std::string, Value> member = std::make_pair(keystr, value);
+    const Value &operator[](size_t index) const { return values_[index]; }
+    Value &operator[](size_t index) { return values_[index]; }
 
-        return member;
+    /// Values added to an arena array are copied into the arena unless
+    /// they already live there. Heap values added to a heap array, and
+    /// any value that is not owned, are moved.
+    void add(Value v) {
+        values_.push_back(detail::adopt(std::move(v), arena()));
     }
 
-    // member ',' members
-    void parseMembers(Object &obj) {
-        std::pair<std::string, Value> member = parseMember();
-        obj.add(member);
-        if (peek() == ',') {
-            next();
-            parseMembers(obj);
-        }
+    /// Construct a value from \p args and add it, returns the new element.
+    template <typename... Args> Value &emplace(Args &&...args) {
+        add(Value(std::forward<Args>(args)...));
+        return values_[values_.size() - 1];
     }
 
-    Value parseValue() {
-        char ch = peek();
-        switch (ch) {
-        case 'n':
-            return parseLiteral("null", ValueType::kNull, 4);
-        case 'f':
-            return parseLiteral("false", ValueType::kFalse, 5);
-        case 't':
-            return parseLiteral("true", ValueType::kTrue, 4);
-        case '\"':
-            return parseString();
-        case '[':
-            return parseArray();
-        case '{':
-            return praseObject();
-        default:
-            return parseNumber();
-        }
+    /// Replace element \p index with \p v , kept like in \c add .
+    void set(size_t index, Value v) {
+        values_[index] = detail::adopt(std::move(v), arena());
+    }
+    /// Insert \p v before element \p index , which may be size().
+    void insert(size_t index, Value v) {
+        values_.insert(index, detail::adopt(std::move(v), arena()));
     }
+    /// Remove element \p index , the elements after it move down.
+    void erase(size_t index) { values_.erase(index); }
 
-    Value parseLiteral(const char *literal, ValueType type, size_t n) {
-        const char *p = literal;
-        for (size_t i = 0; i < n; ++i)
-            assert(next() == p[i]);
+    void reserve(size_t n) { values_.reserve(n); }
 
-        Value value(type, Literal(literal, n));
-        return value;
-    }
+    Value *begin() { return values_.begin(); }
+    Value *end() { return values_.end(); }
+    const Value *begin() const { return values_.begin(); }
+    const Value *end() const { return values_.end(); }
 
-    Value parseNumber() {
-        const char *begin = token();
+    size_t size() const { return values_.size(); }
+    Arena *arena() const { return values_.arena(); }
 
-        // sign
-        if (peek() == '-')
-            next();
+  private:
+    friend class detail::TreeBuilder;
+    friend class Value;
 
-        // integer
-        // check(isdigit(peek()), peek(), "Digit"); // 0 - 9
-        assert(isdigit(peek()) == true);
-        if (peek() == '0') { // 0
-            next();
-        } else { // 1- 9
-            while (isdigit(peek()))
+    detail::List<Value> values_;
+    mutable std::atomic<uint32_t> refs_{1}; // values holding a heap array.
+};
+
+/// Object value.
+class Object {
+  public:
+    /// <key, value>, the key is a string \c Value .
+    using member_t = std::pair<Value, Value>;
+
+    /// Objects with this many members index their keys on first lookup.
+    static constexpr size_t kIndexThreshold = 16;
+
+    explicit Object(Arena *arena = nullptr) : memberList_(arena) {}
+    Object(const member_t &member) : memberList_(nullptr) { add(member); }
+    Object(member_t &&member) : memberList_(nullptr) {
+        add(std::move(member));
+    }
+    Object(const Object &rhs, Arena *arena = nullptr)
+        : memberList_(rhs.memberList_, arena) {}
+    Object(Object &&rhs) noexcept
+        : memberList_(std::move(rhs.memberList_)),
+          index_(rhs.index_.exchange(nullptr, std::memory_order_relaxed)) {}
+    Object &operator=(Object rhs) noexcept {
+        memberList_.swap(rhs.memberList_);
+        Index *index = index_.load(std::memory_order_relaxed);
+        index_.store(rhs.index_.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+        rhs.index_.store(index, std::memory_order_relaxed);
+        return *this;
+    }
+    ~Object() {
+        if (!arena())
+            std::free(index_.load(std::memory_order_relaxed));
+    }
+
+    const member_t &operator[](size_t index) const {
+        return memberList_[index];
+    }
+
+    /// Value of \p key , or an unknown \c Value if absent.
+    const Value &operator[](std::string_view key) const {
+        static const Value unknown;
+        const Value *value = find(key);
+        return value ? *value : unknown;
+    }
+
+    /// Value of \p key , null if absent. The first member wins when a key
+    /// repeats. Small objects are scanned, larger ones hash into an index
+    /// built on first lookup and extended as members are added. Concurrent
+    /// lookups are safe, one index is published and the others dropped.
+    const Value *find(std::string_view key) const {
+        if (size() < kIndexThreshold)
+            return find(key, 0);
+        return find(key, detail::hashKey(key.data(), key.size()));
+    }
+
+    /// Value of \p key , null if absent. Keys can not be changed in place,
+    /// they are indexed.
+    Value *find(std::string_view key) {
+        return const_cast<Value *>(std::as_const(*this).find(key));
+    }
+
+    /// Members added to an arena object are copied into the arena unless
+    /// they already live there, like \c Array::add .
+    void add(member_t member) {
+        emplace(std::move(member.first), std::move(member.second));
+    }
+
+    /// Add the member \p key : \p value , returns the new value.
+    Value &emplace(Value key, Value value) {
+        assert(key.isString());
+        memberList_.push_back(
+            member_t(detail::adopt(std::move(key), arena()),
+                     detail::adopt(std::move(value), arena())));
+
+        // a writer has the object to itself, the index is kept in place.
+        Index *index = index_.load(std::memory_order_relaxed);
+        if (index && size() * 2 > index->capacity) {
+            if (!arena())
+                std::free(index);
+            index_.store(buildIndex(false), std::memory_order_relaxed);
+        } else if (index) {
+            insert(index, static_cast<uint32_t>(size() - 1));
+        }
+        return memberList_[memberList_.size() - 1].second;
+    }
+
+    /// Set \p key to \p value , in place of the value of the first member
+    /// with that key or as a new member. Returns the value.
+    Value &set(std::string_view key, Value value) {
+        if (Value *v = find(key)) {
+            *v = detail::adopt(std::move(value), arena());
+            return *v;
+        }
+        return emplace(Value(String(key.data(), key.size()), arena()),
+                       std::move(value));
+    }
+
+    /// Insert the member \p key : \p value before member \p index , which
+    /// may be size(). Members are kept like in \c add .
+    void insert(size_t index, Value key, Value value) {
+        assert(key.isString());
+        memberList_.insert(index,
+                           member_t(detail::adopt(std::move(key), arena()),
+                                    detail::adopt(std::move(value), arena())));
+        dropIndex();
+    }
+    /// Remove member \p index , the members after it move down.
+    void erase(size_t index) {
+        memberList_.erase(index);
+        dropIndex();
+    }
+    /// Remove every member with key \p key , returns how many there were.
+    size_t erase(std::string_view key) {
+        size_t n = 0;
+        for (size_t i = size(); i-- > 0;) {
+            if (memberList_[i].first.getString().view() == key) {
+                memberList_.erase(i);
+                ++n;
+            }
+        }
+        if (n > 0)
+            dropIndex();
+        return n;
+    }
+
+    void reserve(size_t n) { memberList_.reserve(n); }
+
+    // Members are read only, a key changed in place would go stale in the
+    // index.
+    const member_t *begin() const { return memberList_.begin(); }
+    const member_t *end() const { return memberList_.end(); }
+
+    size_t size() const { return memberList_.size(); }
+    Arena *arena() const { return memberList_.arena(); }
+
+  private:
+    friend class detail::TreeBuilder;
+    friend class detail::Patcher;
+    friend class Value;
+    friend class Pointer;
+
+    // Lookup with the detail::hashKey() of \p key , only used by indexed
+    // objects.
+    const Value *find(std::string_view key, uint32_t hash) const {
+        if (size() < kIndexThreshold) {
+            for (const member_t &member : memberList_)
+                if (member.first.getString().view() == key)
+                    return &member.second;
+            return nullptr;
+        }
+
+        Index *index = index_.load(std::memory_order_acquire);
+        if (!index)
+            index = publishIndex();
+        uint32_t mask = index->capacity - 1;
+        for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &slot = index->slots()[i];
+            if (slot.member == 0)
+                return nullptr;
+            const member_t &member = memberList_[slot.member - 1];
+            if (slot.hash == hash && member.first.getString().view() == key)
+                return &member.second;
+        }
+    }
+
+    // Open addressing slot, member is index + 1 and 0 when empty.
+    struct Slot {
+        uint32_t hash;
+        uint32_t member;
+    };
+
+    // Slots follow the header.
+    struct Index {
+        uint32_t capacity;
+        uint32_t padding;
+        Slot *slots() { return reinterpret_cast<Slot *>(this + 1); }
+    };
+
+    // Index of all members with a load factor under 1/2. A lookup builds
+    // it with the thread safe arena allocation, it may race other lookups.
+    Index *buildIndex(bool shared) const {
+        size_t capacity = 64;
+        while (capacity < size() * 2)
+            capacity *= 2;
+        assert(capacity <= UINT32_MAX);
+        size_t bytes = sizeof(Index) + sizeof(Slot) * capacity;
+        void *p = !arena()  ? std::malloc(bytes)
+                  : shared ? arena()->allocateShared(bytes)
+                           : arena()->allocate(bytes, alignof(Index));
+        Index *index = static_cast<Index *>(p);
+        index->capacity = static_cast<uint32_t>(capacity);
+        std::memset(index->slots(), 0, sizeof(Slot) * capacity);
+        for (size_t i = 0; i < size(); ++i)
+            insert(index, static_cast<uint32_t>(i));
+        return index;
+    }
+
+    // Members moved, the next lookup indexes them again. Only a writer
+    // erases, it has the object to itself.
+    void dropIndex() {
+        Index *index = index_.exchange(nullptr, std::memory_order_relaxed);
+        if (!arena())
+            std::free(index);
+    }
+
+    // The first index published wins.
+    Index *publishIndex() const {
+        Index *index = buildIndex(true);
+        Index *published = nullptr;
+        if (index_.compare_exchange_strong(published, index,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire))
+            return index;
+        if (!arena())
+            std::free(index);
+        return published;
+    }
+
+    void insert(Index *index, uint32_t member) const {
+        std::string_view key = memberList_[member].first.getString().view();
+        uint32_t hash = detail::hashKey(key.data(), key.size());
+        uint32_t mask = index->capacity - 1;
+        Slot *slots = index->slots();
+        uint32_t i = hash & mask;
+        for (; slots[i].member != 0; i = (i + 1) & mask) {
+            const Slot &slot = slots[i];
+            const Value &other = memberList_[slot.member - 1].first;
+            if (slot.hash == hash && other.getString().view() == key)
+                return; // repeated key, the first one stays.
+        }
+        slots[i] = Slot{hash, member + 1};
+    }
+
+    // use a list keep JSON order.
+    detail::List<member_t> memberList_;
+    mutable std::atomic<Index *> index_{nullptr};
+    mutable std::atomic<uint32_t> refs_{1}; // values holding a heap object.
+};
+
+inline Value::Value(const String &str, Arena *arena)
+    : size_(static_cast<uint32_t>(str.size())),
+      flags_(arena ? 0 : kOwned),
+      type_(kString) {
+    assert(str.size() <= UINT32_MAX);
+    str_ = copyChars(str.data(), str.size(), arena);
+}
+inline Value::Value(const Array &array)
+    : size_(0), flags_(kOwned), type_(kArray) {
+    array_ = new Array(array);
+}
+inline Value::Value(Array &&array) : size_(0), flags_(kOwned), type_(kArray) {
+    array_ = new Array(std::move(array));
+}
+inline Value::Value(const Object &obj)
+    : size_(0), flags_(kOwned), type_(kObject) {
+    object_ = new Object(obj);
+}
+inline Value::Value(Object &&obj) : size_(0), flags_(kOwned), type_(kObject) {
+    object_ = new Object(std::move(obj));
+}
+
+inline Value::Value(const Value &rhs, Arena *arena)
+    : size_(rhs.size_), flags_(arena ? 0 : kOwned), type_(rhs.type_) {
+    switch (type_) {
+    case kString: {
+        String str = rhs.getString();
+        size_ = static_cast<uint32_t>(str.size());
+        str_ = copyChars(str.data(), str.size(), arena);
+        if ((rhs.flags_ & (kEscaped | kVerbatim)) == kVerbatim)
+            flags_ |= kVerbatim;
+        break;
+    }
+    case kArray:
+        if (arena)
+            array_ = arena->create<Array>(*rhs.array_, arena);
+        else if (rhs.isOwned())
+            array_ = share(rhs.array_);
+        else
+            array_ = new Array(*rhs.array_);
+        break;
+    case kObject:
+        if (arena)
+            object_ = arena->create<Object>(*rhs.object_, arena);
+        else if (rhs.isOwned())
+            object_ = share(rhs.object_);
+        else
+            object_ = new Object(*rhs.object_);
+        break;
+    default:
+        flags_ = rhs.flags_ & ~kOwned;
+        number_ = rhs.number_;
+    }
+}
+
+inline void Value::destroy() {
+    if (!isOwned())
+        return;
+
+    switch (type_) {
+    case kString:
+        std::free(const_cast<char *>(str_));
+        break;
+    case kArray:
+        if (array_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete array_;
+        break;
+    case kObject:
+        if (object_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete object_;
+        break;
+    default:
+        break;
+    }
+}
+
+inline bool Value::isShared() const {
+    if (!isOwned())
+        return false;
+    if (type_ == kArray)
+        return array_->refs_.load(std::memory_order_acquire) > 1;
+    if (type_ == kObject)
+        return object_->refs_.load(std::memory_order_acquire) > 1;
+    return false;
+}
+
+// The copy holds the children, they become shared a level down.
+inline void Value::detach() {
+    if (!isShared())
+        return;
+    Value copy = type_ == kArray ? Value(Array(*array_))
+                                 : Value(Object(*object_));
+    swap(copy);
+}
+
+/// Deep equality. Numbers are equal by value, objects whatever the order of
+/// their members.
+inline bool operator==(const Value &lhs, const Value &rhs) {
+    if (lhs.type() != rhs.type())
+        return false;
+    switch (lhs.type()) {
+    case kNumber: {
+        Number a = lhs.getNumber(), b = rhs.getNumber();
+        if (a.isInt64() && b.isInt64())
+            return a.getInt64() == b.getInt64();
+        if (a.isUint64() && b.isUint64())
+            return a.getUint64() == b.getUint64();
+        return a.getNumber() == b.getNumber();
+    }
+    case kString:
+        return lhs.getString().view() == rhs.getString().view();
+    case kArray: {
+        const Array &a = lhs.getArray(), &b = rhs.getArray();
+        return a.size() == b.size() &&
+               std::equal(a.begin(), a.end(), b.begin());
+    }
+    case kObject: {
+        const Object &a = lhs.getObject(), &b = rhs.getObject();
+        if (a.size() != b.size())
+            return false;
+        for (const Object::member_t &member : a) {
+            const Value *other = b.find(member.first.getString().view());
+            if (!other || !(member.second == *other))
+                return false;
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+inline bool operator!=(const Value &lhs, const Value &rhs) {
+    return !(lhs == rhs);
+}
+
+/// Whole file input.
+/// Regular files are mapped read only and parsed in place on POSIX, other
+/// files are read into memory. Either way the content is followed by at
+/// least \c kPadding zero bytes, so it is NUL terminated and SIMD loads may
+/// run past the end. A mapped file must not shrink while in use.
+class FileStream {
+  public:
+    static constexpr size_t kPadding = 64;
+
+    FileStream(const char *filename)
+        : filename_(filename), data_(nullptr), size_(0), mapped_(0) {
+#if NEXTJSON_POSIX
+        if (map())
+            return;
+#endif
+        // read in large chunks, the size of a pipe is not known up front.
+        std::ifstream input(filename, std::ios::binary);
+        char chunk[64 * 1024];
+        while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0)
+            content_.insert(content_.end(), chunk, chunk + input.gcount());
+        size_ = content_.size();
+        content_.resize(size_ + kPadding, '\0');
+        data_ = content_.data();
+    }
+    ~FileStream() {
+#if NEXTJSON_POSIX
+        if (mapped_)
+            munmap(const_cast<char *>(data_), mapped_);
+#endif
+    }
+    FileStream(const FileStream &) = delete;
+    FileStream &operator=(const FileStream &) = delete;
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isMapped() const { return mapped_ != 0; }
+
+  private:
+#if NEXTJSON_POSIX
+    bool map() {
+        int fd = open(filename_, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        // reserve the file and padding pages zeroed, then put the file over
+        // their start.
+        size_t n = static_cast<size_t>(st.st_size);
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t total = (n + page - 1) / page * page +
+                       (kPadding + page - 1) / page * page;
+        void *base = mmap(nullptr, total, PROT_READ,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base != MAP_FAILED &&
+            mmap(base, n, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+                MAP_FAILED) {
+            munmap(base, total);
+            base = MAP_FAILED;
+        }
+        close(fd);
+        if (base == MAP_FAILED)
+            return false;
+
+        posix_madvise(base, n, POSIX_MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(base);
+        size_ = n;
+        mapped_ = total;
+        return true;
+    }
+#endif
+
+    const char *filename_;
+    const char *data_;
+    size_t size_;
+    size_t mapped_; // bytes mapped at data_, 0 if read.
+    std::vector<char> content_;
+};
+
+/// Wrapper of std::vector<char>
+template <size_t N = 64> class Buffer {
+  public:
+    Buffer()
+        : size_(0),
+          capacity_(N - sizeof(size_t) * 2 - sizeof(char *)),
+          ptr_(nullptr) {
+        static_assert(N != 0 && ((N & (N - 1)) == 0), "Not Power of 2");
+    }
+
+    ~Buffer() {
+        if (ptr_)
+            std::free(ptr_);
+    }
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    char *begin() { return ptr_ ? ptr_ : data_; }
+    char *end() { return begin() + size_; }
+    const char *data() const { return ptr_ ? ptr_ : data_; }
+    void clear() { size_ = 0; }
+
+    void append(const char *data, size_t n) {
+        grow(n);
+        std::copy(data, data + n, end());
+        size_ += n;
+    }
+
+    void append(const char *data) {
+        append(data, std::char_traits<char>::length(data));
+    }
+    void append(const std::string &str) { append(str.data(), str.length()); }
+    void append(char ch) { append(&ch, 1); }
+
+  private:
+    void grow(size_t n) {
+        size_t newSize = size_ + n;
+        if (newSize < capacity_)
+            return;
+
+        // grow witg 1.5 size.
+        capacity_ = std::max(newSize, capacity_ + (capacity_ + 1) / 2);
+        char *p = static_cast<char *>(std::malloc(capacity_));
+        std::copy(data(), data() + size_, p);
+        std::swap(p, ptr_);
+        std::free(p);
+    }
+
+    size_t size_;
+    size_t capacity_;
+    char *ptr_;
+    char data_[N - sizeof(size_t) * 2 - sizeof(char *)];
+};
+
+using SmallBuffer = Buffer<64>;
+using MeduimBuffer = Buffer<256>;
+using LargeBuffer = Buffer<1024>;
+
+namespace detail {
+
+// "00" to "99".
+static const char kDigitPairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/// Write \p v at \p out , which needs room for 20 characters. Returns the
+/// length written.
+inline size_t formatUint64(uint64_t v, char *out) {
+    char buf[20];
+    char *p = buf + sizeof(buf);
+    // two digits per division.
+    while (v >= 100) {
+        const char *pair = kDigitPairs + (v % 100) * 2;
+        v /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (v >= 10) {
+        const char *pair = kDigitPairs + v * 2;
+        *--p = pair[1];
+        *--p = pair[0];
+    } else {
+        *--p = static_cast<char>('0' + v);
+    }
+
+    size_t n = buf + sizeof(buf) - p;
+    std::copy(p, p + n, out);
+    return n;
+}
+
+/// Write \p v at \p out , which needs room for 20 characters.
+inline size_t formatInt64(int64_t v, char *out) {
+    if (v >= 0)
+        return formatUint64(static_cast<uint64_t>(v), out);
+    *out = '-';
+    return 1 + formatUint64(0 - static_cast<uint64_t>(v), out + 1);
+}
+
+/// Write the shortest text that reads back as exactly \p v at \p out , which
+/// needs room for 32 characters. Infinity and NaN have no JSON form and are
+/// written as null.
+inline size_t formatDouble(double v, char *out) {
+    if (!std::isfinite(v)) {
+        std::copy("null", "null" + 4, out);
+        return 4;
+    }
+
+    // integral values print as integers.
+    if (v > -1e15 && v < 1e15 && v == static_cast<double>(int64_t(v)) &&
+        !(v == 0 && std::signbit(v)))
+        return formatInt64(int64_t(v), out);
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    // shortest round trip (Ryu in libstdc++ and MSVC).
+    std::to_chars_result result = std::to_chars(out, out + 32, v);
+    return result.ptr - out;
+#else
+    // round trip, not always the shortest.
+    return snprintf(out, 32, "%.17g", v);
+#endif
+}
+
+/// First character in [\p p , \p end ) that a JSON string has to escape,
+/// \p end if there is none. Defined with the simd scanners.
+inline const char *findEscape(const char *p, const char *end);
+
+} // namespace detail
+
+/// Value on a tape of \c BinaryDocument , a view of the encoded words.
+/// An unknown \c BinaryValue stands for a missing one.
+class BinaryValue {
+  public:
+    BinaryValue() : p_(nullptr) {}
+
+    ValueType type() const {
+        return p_ ? static_cast<ValueType>(*p_ & 0xff) : kUnknown;
+    }
+    bool isNull() const { return type() == kNull; }
+    bool isBool() const { return type() == kTrue || type() == kFalse; }
+    bool isNumber() const { return type() == kNumber; }
+    bool isString() const { return type() == kString; }
+    bool isArray() const { return type() == kArray; }
+    bool isObject() const { return type() == kObject; }
+
+    bool getBool() const {
+        assert(isBool());
+        return type() == kTrue;
+    }
+    Number getNumber() const {
+        assert(isNumber());
+        switch ((*p_ >> 8) & 0xff) {
+        case Number::kInt64:
+            return Number(static_cast<int64_t>(p_[1]));
+        case Number::kUint64:
+            return Number(p_[1]);
+        default: {
+            double d;
+            std::memcpy(&d, &p_[1], sizeof(d));
+            return Number(d);
+        }
+        }
+    }
+    /// A view of the encoded characters, NUL-terminated.
+    String getString() const {
+        assert(isString());
+        return String(reinterpret_cast<const char *>(p_ + 1), count());
+    }
+
+    /// Elements of an array or members of an object.
+    size_t size() const {
+        assert(isArray() || isObject());
+        return count();
+    }
+    /// Element \p i of an array.
+    BinaryValue operator[](size_t i) const {
+        assert(isArray());
+        return i < count() ? BinaryValue(entry(i)) : BinaryValue();
+    }
+    /// Key and value of member \p i of an object.
+    BinaryValue key(size_t i) const {
+        assert(isObject() && i < count());
+        return BinaryValue(entry(i));
+    }
+    BinaryValue value(size_t i) const {
+        assert(isObject() && i < count());
+        return BinaryValue(skip(entry(i)));
+    }
+    /// Value of \p key in an object, the first member wins when a key
+    /// repeats.
+    BinaryValue operator[](std::string_view key) const {
+        assert(isObject());
+        for (size_t i = 0; i < count(); ++i) {
+            const uint64_t *p = entry(i);
+            if (BinaryValue(p).getString().view() == key)
+                return BinaryValue(skip(p));
+        }
+        return BinaryValue();
+    }
+
+    /// Copy this subtree into a \c Value , in \p arena or on the heap.
+    Value materialize(Arena *arena = nullptr) const {
+        switch (type()) {
+        case kNumber:
+            return Value(getNumber());
+        case kString:
+            return Value(getString(), arena);
+        case kArray: {
+            Array array(arena);
+            array.reserve(count());
+            for (size_t i = 0; i < count(); ++i)
+                array.add(BinaryValue(entry(i)).materialize(arena));
+            return arena ? Value(arena->create<Array>(std::move(array)))
+                         : Value(std::move(array));
+        }
+        case kObject: {
+            Object obj(arena);
+            obj.reserve(count());
+            for (size_t i = 0; i < count(); ++i) {
+                const uint64_t *p = entry(i);
+                obj.emplace(BinaryValue(p).materialize(arena),
+                            BinaryValue(skip(p)).materialize(arena));
+            }
+            return arena ? Value(arena->create<Object>(std::move(obj)))
+                         : Value(std::move(obj));
+        }
+        case kUnknown:
+            return Value();
+        default:
+            return Value(type());
+        }
+    }
+
+  private:
+    friend class BinaryDocument;
+    friend class TapeDocument;
+    friend class Formatter;
+
+    explicit BinaryValue(const uint64_t *p) : p_(p) {}
+
+    size_t count() const { return static_cast<size_t>(*p_ >> 32); }
+    bool isVerbatim() const { return (*p_ >> 8) & 1; }
+    // Offset table of an array or an object, it closes the content.
+    const uint64_t *table() const { return p_ + 2 + p_[1] - (count() + 1) / 2; }
+    // Word offset of entry \p i from the head.
+    uint32_t offset(size_t i) const {
+        uint32_t offset;
+        std::memcpy(&offset,
+                    reinterpret_cast<const char *>(table()) +
+                        i * sizeof(offset),
+                    sizeof(offset));
+        return offset;
+    }
+    const uint64_t *entry(size_t i) const { return p_ + offset(i); }
+
+    // Word just past the value at \p p if it is well formed and ends by
+    // \p end , nesting at most \p depth containers, null otherwise.
+    static const uint64_t *check(const uint64_t *p, const uint64_t *end,
+                                 size_t depth) {
+        size_t words = end - p;
+        if (words == 0)
+            return nullptr;
+        switch (static_cast<ValueType>(*p & 0xff)) {
+        case kNull:
+        case kFalse:
+        case kTrue:
+            return p + 1;
+        case kNumber:
+            return words >= 2 ? p + 2 : nullptr;
+        case kString: {
+            size_t n = static_cast<size_t>(*p >> 32);
+            if (n / sizeof(uint64_t) + 2 > words ||
+                reinterpret_cast<const char *>(p + 1)[n] != '\0')
+                return nullptr;
+            return skip(p);
+        }
+        case kArray:
+        case kObject: {
+            BinaryValue value(p);
+            size_t n = value.count();
+            if (depth == 0 || words < 2 || p[1] > words - 2 ||
+                (n + 1) / 2 > p[1])
+                return nullptr;
+            // the entries in order, then the table.
+            const uint64_t *table = value.table();
+            const uint64_t *q = p + 2;
+            for (size_t i = 0; i < n && q; ++i) {
+                if (value.offset(i) != static_cast<size_t>(q - p))
+                    return nullptr;
+                if (value.isObject()) {
+                    if (q == table || (*q & 0xff) != kString)
+                        return nullptr;
+                    q = check(q, table, depth - 1);
+                }
+                q = q ? check(q, table, depth - 1) : nullptr;
+            }
+            return q == table ? skip(p) : nullptr;
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    // Word just past the value at \p p .
+    static const uint64_t *skip(const uint64_t *p) {
+        switch (static_cast<ValueType>(*p & 0xff)) {
+        case kNumber:
+            return p + 2;
+        case kString:
+            return p + 1 + (*p >> 32) / sizeof(uint64_t) + 1;
+        case kArray:
+        case kObject:
+            return p + 2 + p[1];
+        default:
+            return p + 1;
+        }
+    }
+
+    const uint64_t *p_;
+};
+
+/// Reader of a binary tape in place, such as the output of
+/// \c BinaryWriter in a mapped \c FileStream , which has to outlive the
+/// document. Nothing is decoded up front, values are views of the words.
+/// The tape is 64-bit words in host byte order: a header word, then each
+/// value in document order as a head word with the \c ValueType in the low
+/// byte and a count in the high half.
+///   - null, false, true: the head only.
+///   - number: the head with the \c Number::Type in the second byte, then
+///     the 64 bits of the number.
+///   - string: the head with the size and 1 in the second byte if the
+///     characters need no escaping in JSON, then the characters,
+///     NUL-terminated and zero padded to a whole word.
+///   - array, object: the head with the elements or members, the words
+///     after it so the container is skipped in one step, the entries, then
+///     a table of 32-bit word offsets from the head to each entry. A member
+///     is its key string and its value.
+/// The input has to be 8 bytes aligned and from a machine of the same byte
+/// order.
+class BinaryDocument {
+  public:
+    /// "NJSB" and the version in the high half.
+    static constexpr uint64_t kMagic = 0x42534a4eull | (1ull << 32);
+
+    /// Deepest nesting of arrays and objects accepted.
+    static constexpr size_t kMaxDepth = 1024;
+
+    /// The tape is walked once to check that every value is within \p n
+    /// bytes, nothing is decoded.
+    BinaryDocument(const char *data, size_t n)
+        : words_(reinterpret_cast<const uint64_t *>(data)),
+          size_(n / sizeof(uint64_t)),
+          valid_(reinterpret_cast<uintptr_t>(data) % alignof(uint64_t) == 0 &&
+                 n % sizeof(uint64_t) == 0 && size_ >= 1 &&
+                 words_[0] == kMagic) {
+        if (valid_ && size_ > 1)
+            valid_ = BinaryValue::check(words_ + 1, words_ + size_,
+                                        kMaxDepth) == words_ + size_;
+    }
+    explicit BinaryDocument(const FileStream &input)
+        : BinaryDocument(input.data(), input.size()) {}
+
+    /// False if the input is not a whole binary document.
+    bool valid() const { return valid_; }
+    /// The document, unknown if it was empty or is not valid.
+    BinaryValue root() const {
+        return valid_ && size_ > 1 ? BinaryValue(words_ + 1) : BinaryValue();
+    }
+
+  private:
+    const uint64_t *words_;
+    size_t size_;
+    bool valid_;
+};
+
+/// Formatter options.
+struct FormatOptions {
+    /// No whitespace at all, for the wire.
+    bool compact = false;
+    /// Pretty mode puts every element on its own line, indented by
+    /// \p indentWidth copies of \p indentChar per level.
+    char indentChar = '\t';
+    uint32_t indentWidth = 1;
+};
+
+/// Destination of streamed \c Formatter output.
+class Sink {
+  public:
+    virtual ~Sink() {}
+    /// Take \p n bytes at \p data , valid only during the call.
+    virtual void write(const char *data, size_t n) = 0;
+};
+
+/// Write to a stdio stream.
+class FileSink : public Sink {
+  public:
+    explicit FileSink(FILE *file) : file_(file), ok_(true) {}
+
+    /// False once a write came up short, later output is dropped.
+    bool ok() const { return ok_; }
+    void write(const char *data, size_t n) override {
+        if (ok_)
+            ok_ = std::fwrite(data, 1, n, file_) == n;
+    }
+
+  private:
+    FILE *file_;
+    bool ok_;
+};
+
+#if NEXTJSON_POSIX
+/// Write to a file descriptor, such as a pipe or a socket.
+class FdSink : public Sink {
+  public:
+    explicit FdSink(int fd) : fd_(fd), error_(0) {}
+
+    /// errno of the failed write, later output is dropped.
+    int error() const { return error_; }
+    void write(const char *data, size_t n) override {
+        while (n > 0 && error_ == 0) {
+            ssize_t written = ::write(fd_, data, n);
+            if (written >= 0) {
+                data += written;
+                n -= written;
+            } else if (errno != EINTR) {
+                error_ = errno;
+            }
+        }
+    }
+
+  private:
+    int fd_;
+    int error_;
+};
+#endif
+
+/// Hand every chunk to a callback.
+class CallbackSink : public Sink {
+  public:
+    using callback_t = std::function<void(const char *, size_t)>;
+
+    explicit CallbackSink(callback_t callback)
+        : callback_(std::move(callback)) {}
+
+    void write(const char *data, size_t n) override { callback_(data, n); }
+
+  private:
+    callback_t callback_;
+};
+
+class Formatter {
+  public:
+    explicit Formatter(FormatOptions options = FormatOptions())
+        : options_(options), sink_(nullptr), chunkSize_(0) {}
+    /// Stream to \p sink in chunks of about \p chunkSize bytes, so memory
+    /// stays bounded by the chunk size (plus the largest string) whatever
+    /// the document size.
+    explicit Formatter(Sink &sink, FormatOptions options = FormatOptions(),
+                       size_t chunkSize = 64 * 1024)
+        : options_(options), sink_(&sink), chunkSize_(chunkSize) {}
+
+    /// Output not yet flushed, everything when there is no sink.
+    const char *data() const { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+    const FormatOptions &options() const { return options_; }
+    void setOptions(const FormatOptions &options) {
+        options_ = options;
+        newline_.clear();
+    }
+    void format(const Value &root) {
+        formatValue(root, 0);
+        if (sink_)
+            flush();
+    }
+    /// Format a tape value, such as the root of a \c TapeDocument .
+    void format(const BinaryValue &root) {
+        formatTape(root, 0);
+        if (sink_)
+            flush();
+    }
+
+    /// Drop the output not yet flushed, the buffer keeps its capacity for
+    /// the next format().
+    void clear() { buffer_.clear(); }
+
+    /// Hand buffered output to the sink.
+    void flush() {
+        assert(sink_);
+        if (buffer_.size() > 0)
+            sink_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+  private:
+    // Checked between elements, a full chunk goes to the sink.
+    void maybeFlush() {
+        if (sink_ && buffer_.size() >= chunkSize_)
+            flush();
+    }
+
+    // Line break and indent of \p depth in one append, pretty mode only.
+    void formatNewline(uint32_t depth) {
+        size_t n = 1 + size_t(depth) * options_.indentWidth;
+        if (newline_.size() < n) {
+            // deeper than ever, grow the precomputed indent.
+            newline_.assign(std::max(n, newline_.size() * 2),
+                            options_.indentChar);
+            newline_[0] = '\n';
+        }
+        buffer_.append(newline_.data(), n);
+    }
+
+    void formatValue(const Value &value, uint32_t depth) {
+        switch (value.type()) {
+        case kNull:
+        case kFalse:
+        case kTrue:
+            return formatLiteral(value, depth);
+        case kNumber:
+            return formatNumber(value, depth);
+        case kString:
+            return formatString(value, depth);
+        case kArray:
+            return formatArray(value, depth);
+        case kObject:
+            return formatObject(value, depth);
+        case kUnknown:
+            return; /* do nothing. */
+        }
+    }
+    void formatLiteral(const Value &value, uint32_t depth) {
+        buffer_.append(typeToString(value.type()));
+    }
+    void formatNumber(const Value &value, uint32_t depth) {
+        formatNumber(value.getNumber());
+    }
+    void formatNumber(Number number) {
+        char buf[32];
+        size_t n;
+        if (number.isInt64())
+            n = detail::formatInt64(number.getInt64(), buf);
+        else if (number.isUint64())
+            n = detail::formatUint64(number.getUint64(), buf);
+        else
+            n = detail::formatDouble(number.getNumber(), buf);
+        buffer_.append(buf, n);
+    }
+    void formatString(const Value &value, uint32_t depth) {
+        buffer_.append('\"');
+        formatStringBody(value);
+        buffer_.append('\"');
+    }
+    // Parsed strings are written back in their source form, other strings
+    // are escaped.
+    void formatStringBody(const Value &value) {
+        String raw = value.getRawString();
+        if (raw.data())
+            return buffer_.append(raw.data(), raw.size());
+        formatEscaped(value.getString());
+    }
+    // Runs without escapes are found with simd and copied whole.
+    void formatEscaped(String str) {
+        const char *run = str.data(), *end = run + str.size();
+        for (;;) {
+            const char *p = detail::findEscape(run, end);
+            buffer_.append(run, p - run);
+            if (p == end)
+                break;
+            run = p + 1;
+            unsigned char ch = *p;
+            switch (ch) {
+            case '\"':
+                buffer_.append("\\\"", 2);
+                break;
+            case '\\':
+                buffer_.append("\\\\", 2);
+                break;
+            case '\b':
+                buffer_.append("\\b", 2);
+                break;
+            case '\f':
+                buffer_.append("\\f", 2);
+                break;
+            case '\n':
+                buffer_.append("\\n", 2);
+                break;
+            case '\r':
+                buffer_.append("\\r", 2);
+                break;
+            case '\t':
+                buffer_.append("\\t", 2);
+                break;
+            default: {
+                const char hex[] = "0123456789abcdef";
+                char buf[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 15]};
+                buffer_.append(buf, 6);
+            }
+            }
+        }
+    }
+    void formatArray(const Value &value, uint32_t depth) {
+        const Array &arr = value.getArray();
+
+        buffer_.append('[');
+        for (size_t i = 0; i < arr.size(); ++i) {
+            if (i > 0)
+                buffer_.append(',');
+            if (!options_.compact)
+                formatNewline(depth + 1);
+            formatValue(arr[i], depth + 1);
+            maybeFlush();
+        }
+        if (arr.size() > 0 && !options_.compact)
+            formatNewline(depth);
+        buffer_.append(']');
+    }
+    void formatObject(const Value &value, uint32_t depth) {
+        const Object &obj = value.getObject();
+
+        buffer_.append('{');
+        for (size_t i = 0; i < obj.size(); ++i) {
+            const Object::member_t &member = obj[i];
+            if (i > 0)
+                buffer_.append(',');
+            if (!options_.compact)
+                formatNewline(depth + 1);
+
+            // print key
+            buffer_.append('\"');
+            formatStringBody(member.first);
+            buffer_.append("\":", 2);
+
+            // value.
+            formatValue(member.second, depth + 1);
+            maybeFlush();
+        }
+        if (obj.size() > 0 && !options_.compact)
+            formatNewline(depth);
+        buffer_.append('}');
+    }
+
+    // The tape is read forward, the same layout as formatValue().
+    void formatTape(const BinaryValue &value, uint32_t depth) {
+        switch (value.type()) {
+        case kNumber:
+            return formatNumber(value.getNumber());
+        case kString:
+            buffer_.append('\"');
+            formatTapeString(value);
+            buffer_.append('\"');
+            return;
+        case kArray:
+        case kObject: {
+            bool array = value.isArray();
+            size_t n = value.size();
+            const uint64_t *p = value.p_ + 2;
+            buffer_.append(array ? '[' : '{');
+            for (size_t i = 0; i < n; ++i) {
+                if (i > 0)
+                    buffer_.append(',');
+                if (!options_.compact)
+                    formatNewline(depth + 1);
+                if (!array) {
+                    buffer_.append('\"');
+                    formatTapeString(BinaryValue(p));
+                    buffer_.append("\":", 2);
+                    p = BinaryValue::skip(p);
+                }
+                formatTape(BinaryValue(p), depth + 1);
+                p = BinaryValue::skip(p);
+                maybeFlush();
+            }
+            if (n > 0 && !options_.compact)
+                formatNewline(depth);
+            buffer_.append(array ? ']' : '}');
+            return;
+        }
+        case kUnknown:
+            return;
+        default:
+            buffer_.append(typeToString(value.type()));
+        }
+    }
+    void formatTapeString(const BinaryValue &str) {
+        if (str.isVerbatim()) {
+            String s = str.getString();
+            return buffer_.append(s.data(), s.size());
+        }
+        formatEscaped(str.getString());
+    }
+
+    FormatOptions options_;
+    Sink *sink_;
+    size_t chunkSize_;
+    std::string newline_; // "\n" and the deepest indent so far.
+    MeduimBuffer buffer_;
+};
+
+/// Fixed set of threads running parallel loops. Iterations are handed out
+/// one at a time from a shared atomic counter, so a thread that finishes
+/// early takes the next iteration instead of idling and uneven iterations
+/// still balance across threads.
+class ThreadPool {
+  public:
+    /// \p concurrency threads take part in run(), the caller included.
+    explicit ThreadPool(
+        size_t concurrency = std::thread::hardware_concurrency())
+        : generation_(0), active_(0), stop_(false), next_(0) {
+        for (size_t i = 1; i < std::max<size_t>(concurrency, 1); ++i)
+            threads_.emplace_back([this, i] { work(i); });
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread &thread : threads_)
+            thread.join();
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t concurrency() const { return threads_.size() + 1; }
+
+    /// Call fn(worker, i) for every i < \p n and wait for all of them.
+    /// worker < concurrency() tells the calling thread apart, no two calls
+    /// run with the same worker at once. Not reentrant.
+    template <typename Fn> void run(size_t n, Fn fn) {
+        job_ = [this, n, &fn](size_t worker) {
+            for (size_t i; (i = next_.fetch_add(1)) < n;)
+                fn(worker, i);
+        };
+        next_ = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_ = threads_.size();
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        job_(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return active_ == 0; });
+    }
+
+  private:
+    void work(size_t worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock,
+                           [&] { return stop_ || generation_ != seen; });
+                if (stop_)
+                    return;
+                seen = generation_;
+            }
+            job_(worker);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--active_ == 0)
+                done_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    std::function<void(size_t)> job_;
+    uint64_t generation_; // bumped by each run().
+    size_t active_;       // threads still in the current job_.
+    bool stop_;
+    std::atomic<size_t> next_; // next iteration to hand out.
+};
+
+// Instruction set used by the structural scanner.
+enum SimdLevel : uint8_t { kSimdScalar, kSimdSse2, kSimdAvx2, kSimdNeon };
+
+static const char *SimdLevelName[4] = {"scalar", "sse2", "avx2", "neon"};
+
+/// Stringify simd level \p level .
+inline const char *simdToString(SimdLevel level) {
+    return SimdLevelName[level];
+}
+
+/// The widest simd level this CPU runs.
+inline SimdLevel detectSimd() {
+#if NEXTJSON_X86 && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return kSimdAvx2;
+    return kSimdSse2;
+#elif NEXTJSON_X86
+    return kSimdSse2;
+#elif NEXTJSON_NEON
+    return kSimdNeon;
+#else
+    return kSimdScalar;
+#endif
+}
+
+inline SimdLevel bestSimd() {
+    static const SimdLevel level = detectSimd();
+    return level;
+}
+
+inline bool simdSupported(SimdLevel level) {
+    switch (level) {
+    case kSimdScalar:
+        return true;
+    case kSimdSse2:
+        return NEXTJSON_X86;
+    case kSimdAvx2:
+        return bestSimd() == kSimdAvx2;
+    case kSimdNeon:
+        return NEXTJSON_NEON;
+    }
+    return false;
+}
+
+namespace detail {
+
+// Bitmaps of a 64 bytes block, bit i stands for byte i.
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t whitespace;
+    uint64_t op;      // { } [ ] : ,
+    uint64_t high;    // bytes of multibyte UTF-8.
+    uint64_t control; // below 0x20, whitespace included.
+};
+
+inline void classifyScalar(const char *block, BlockMasks &m) {
+    m = BlockMasks{};
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = uint64_t(1) << i;
+        uint8_t byte = static_cast<uint8_t>(block[i]);
+        if (byte >= 0x80)
+            m.high |= bit;
+        else if (byte < 0x20)
+            m.control |= bit;
+        switch (block[i]) {
+        case '\"':
+            m.quote |= bit;
+            break;
+        case '\\':
+            m.backslash |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            m.whitespace |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            m.op |= bit;
+            break;
+        }
+    }
+}
+
+// '[' and ']' differ from '{' and '}' only by 0x20, so brackets and braces
+// take two compares against (ch | 0x20).
+#if NEXTJSON_X86
+inline void classifySse2(const char *block, BlockMasks &m) {
+    m = BlockMasks{};
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(block + 16 * i));
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')),
+                         _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+
+        int shift = 16 * i;
+        auto bits = [](__m128i x) {
+            return uint64_t(uint16_t(_mm_movemask_epi8(x)));
+        };
+        m.quote |= bits(_mm_cmpeq_epi8(v, _mm_set1_epi8('\"'))) << shift;
+        m.backslash |= bits(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << shift;
+        m.whitespace |= bits(ws) << shift;
+        m.op |= bits(op) << shift;
+        // the sign bits are the high bytes as they are.
+        m.high |= bits(v) << shift;
+        __m128i max = _mm_max_epu8(v, _mm_set1_epi8(0x1f));
+        m.control |= bits(_mm_cmpeq_epi8(max, _mm_set1_epi8(0x1f))) << shift;
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2"))) inline uint64_t avx2Bits(__m256i x) {
+    return uint64_t(uint32_t(_mm256_movemask_epi8(x)));
+}
+
+__attribute__((target("avx2"))) inline void
+classifyAvx2(const char *block, BlockMasks &m) {
+    m = BlockMasks{};
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(block + 32 * i));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+                            _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+
+        int shift = 32 * i;
+        m.quote |= avx2Bits(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')))
+                   << shift;
+        m.backslash |=
+            avx2Bits(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << shift;
+        m.whitespace |= avx2Bits(ws) << shift;
+        m.op |= avx2Bits(op) << shift;
+        m.high |= avx2Bits(v) << shift;
+        __m256i max = _mm256_max_epu8(v, _mm256_set1_epi8(0x1f));
+        m.control |=
+            avx2Bits(_mm256_cmpeq_epi8(max, _mm256_set1_epi8(0x1f))) << shift;
+    }
+}
+#endif
+#endif // NEXTJSON_X86
+
+#if NEXTJSON_NEON
+// Pack the high bit of the 64 bytes of 4 compare results.
+inline uint64_t neonBits(uint8x16_t v0, uint8x16_t v1, uint8x16_t v2,
+                         uint8x16_t v3) {
+    const uint8x16_t bit = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                            0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+    uint8x16_t sum0 = vpaddq_u8(vandq_u8(v0, bit), vandq_u8(v1, bit));
+    uint8x16_t sum1 = vpaddq_u8(vandq_u8(v2, bit), vandq_u8(v3, bit));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+inline void classifyNeon(const char *block, BlockMasks &m) {
+    uint8x16_t q[4], b[4], w[4], o[4], h[4], c[4];
+    for (int i = 0; i < 4; ++i) {
+        uint8x16_t v =
+            vld1q_u8(reinterpret_cast<const uint8_t *>(block + 16 * i));
+        uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+        q[i] = vceqq_u8(v, vdupq_n_u8('\"'));
+        b[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+        w[i] = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                                 vceqq_u8(v, vdupq_n_u8('\t'))),
+                        vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')),
+                                 vceqq_u8(v, vdupq_n_u8('\r'))));
+        o[i] = vorrq_u8(vorrq_u8(vceqq_u8(lower, vdupq_n_u8('{')),
+                                 vceqq_u8(lower, vdupq_n_u8('}'))),
+                        vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')),
+                                 vceqq_u8(v, vdupq_n_u8(','))));
+        h[i] = vcgeq_u8(v, vdupq_n_u8(0x80));
+        c[i] = vcltq_u8(v, vdupq_n_u8(0x20));
+    }
+    m.quote = neonBits(q[0], q[1], q[2], q[3]);
+    m.backslash = neonBits(b[0], b[1], b[2], b[3]);
+    m.whitespace = neonBits(w[0], w[1], w[2], w[3]);
+    m.op = neonBits(o[0], o[1], o[2], o[3]);
+    m.high = neonBits(h[0], h[1], h[2], h[3]);
+    m.control = neonBits(c[0], c[1], c[2], c[3]);
+}
+#endif // NEXTJSON_NEON
+
+using ClassifyFn = void (*)(const char *, BlockMasks &);
+
+inline ClassifyFn classifier(SimdLevel level) {
+    switch (level) {
+#if NEXTJSON_X86
+    case kSimdSse2:
+        return classifySse2;
+#if defined(__GNUC__) || defined(__clang__)
+    case kSimdAvx2:
+        return classifyAvx2;
+#endif
+#endif
+#if NEXTJSON_NEON
+    case kSimdNeon:
+        return classifyNeon;
+#endif
+    default:
+        return classifyScalar;
+    }
+}
+
+// '\"', '\\' and everything below 0x20 are escaped in a string. The simd
+// scanners test a register at a time and leave the tail to the scalar one.
+inline bool needsEscape(char ch) {
+    return static_cast<uint8_t>(ch) < 0x20 || ch == '\"' || ch == '\\';
+}
+
+inline const char *findEscapeScalar(const char *p, const char *end) {
+    while (p < end && !needsEscape(*p))
+        ++p;
+    return p;
+}
+
+#if NEXTJSON_X86
+inline const char *findEscapeSse2(const char *p, const char *end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1f)),
+                                         _mm_set1_epi8(0x1f));
+        __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('\"'));
+        __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+        __m128i hit = _mm_or_si128(control, _mm_or_si128(quote, slash));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return findEscapeScalar(p, end);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2"))) inline const char *
+findEscapeAvx2(const char *p, const char *end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i control = _mm256_cmpeq_epi8(
+            _mm256_max_epu8(v, _mm256_set1_epi8(0x1f)), _mm256_set1_epi8(0x1f));
+        __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"'));
+        __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(control, _mm256_or_si256(quote, slash))));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return findEscapeSse2(p, end);
+}
+#endif
+#endif // NEXTJSON_X86
+
+#if NEXTJSON_NEON
+inline const char *findEscapeNeon(const char *p, const char *end) {
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        uint8x16_t hit = vorrq_u8(vcltq_u8(v, vdupq_n_u8(0x20)),
+                                  vorrq_u8(vceqq_u8(v, vdupq_n_u8('\"')),
+                                           vceqq_u8(v, vdupq_n_u8('\\'))));
+        if (vmaxvq_u8(hit) != 0)
+            return findEscapeScalar(p, p + 16);
+    }
+    return findEscapeScalar(p, end);
+}
+#endif
+
+using FindEscapeFn = const char *(*)(const char *, const char *);
+
+inline FindEscapeFn escapeFinder(SimdLevel level) {
+    switch (level) {
+#if NEXTJSON_X86
+    case kSimdSse2:
+        return findEscapeSse2;
+#if defined(__GNUC__) || defined(__clang__)
+    case kSimdAvx2:
+        return findEscapeAvx2;
+#endif
+#endif
+#if NEXTJSON_NEON
+    case kSimdNeon:
+        return findEscapeNeon;
+#endif
+    default:
+        return findEscapeScalar;
+    }
+}
+
+inline const char *findEscape(const char *p, const char *end) {
+    static const FindEscapeFn find = escapeFinder(bestSimd());
+    return find(p, end);
+}
+
+// Bits set on each character escaped by an odd run of backslashes, the run
+// may come from the previous block through \p prevOdd .
+inline uint64_t escapedChars(uint64_t backslash, uint64_t &prevOdd) {
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    const uint64_t oddBits = ~evenBits;
+
+    uint64_t startEdges = backslash & ~(backslash << 1);
+    // flip lowest if we have an odd-length run at the end of the prior block.
+    uint64_t evenStartMask = evenBits ^ prevOdd;
+    uint64_t evenStarts = startEdges & evenStartMask;
+    uint64_t oddStarts = startEdges & ~evenStartMask;
+    uint64_t evenCarries = backslash + evenStarts;
+
+    uint64_t oddCarries = backslash + oddStarts;
+    bool endsOdd = oddCarries < backslash;
+    oddCarries |= prevOdd;
+    prevOdd = endsOdd ? 1 : 0;
+
+    uint64_t evenCarryEnds = evenCarries & ~backslash;
+    uint64_t oddCarryEnds = oddCarries & ~backslash;
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+// Bit i is the xor of bits 0..i, so a quote mask turns into a string mask.
+inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+inline int trailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#endif
+}
+
+inline int popCount(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    return static_cast<int>(__popcnt64(x));
+#endif
+}
+
+// UTF-8 is checked one block at a time while indexing. A block of ASCII
+// only, which classification finds for free, is skipped unless a sequence
+// runs into it from the block before. The last bytes of a block that may
+// start such a sequence go to the next as a tail: the 4 bytes before it
+// as a little endian word, the lowest byte dropped, 0 if no sequence is
+// cut.
+inline uint32_t utf8Tail(const char *end) {
+    uint32_t b1 = uint8_t(end[-1]), b2 = uint8_t(end[-2]),
+             b3 = uint8_t(end[-3]);
+    if (b1 >= 0xc0 || b2 >= 0xe0 || b3 >= 0xf0)
+        return b1 << 24 | b2 << 16 | b3 << 8;
+    return 0;
+}
+
+// Length of the UTF-8 sequence at \p p , 0 if it is malformed, -1 if
+// \p end cuts it first.
+inline int utf8Sequence(const uint8_t *p, const uint8_t *end) {
+    uint8_t lead = p[0], lo = 0x80, hi = 0xbf;
+    int n;
+    if (lead < 0x80)
+        return 1;
+    if (lead < 0xc2) // continuation or overlong.
+        return 0;
+    if (lead < 0xe0) {
+        n = 2;
+    } else if (lead < 0xf0) {
+        n = 3;
+        lo = lead == 0xe0 ? 0xa0 : 0x80; // overlong.
+        hi = lead == 0xed ? 0x9f : 0xbf; // surrogate.
+    } else if (lead < 0xf5) {
+        n = 4;
+        lo = lead == 0xf0 ? 0x90 : 0x80; // overlong.
+        hi = lead == 0xf4 ? 0x8f : 0xbf; // above U+10FFFF.
+    } else {
+        return 0;
+    }
+    for (int i = 1; i < n; ++i, lo = 0x80, hi = 0xbf) {
+        if (p + i == end)
+            return -1;
+        if (p[i] < lo || p[i] > hi)
+            return 0;
+    }
+    return n;
+}
+
+// Offset of the first malformed byte of the 64 byte \p block , -3 to -1
+// for a sequence started in \p tail , 64 if the block is valid.
+inline int utf8Error(const char *block, uint32_t tail) {
+    uint8_t buf[3 + 64];
+    buf[0] = uint8_t(tail >> 8);
+    buf[1] = uint8_t(tail >> 16);
+    buf[2] = uint8_t(tail >> 24);
+    std::memcpy(buf + 3, block, 64);
+
+    const uint8_t *p = buf + 3, *end = buf + sizeof(buf);
+    if (tail) // back to the lead of the cut sequence.
+        p = buf[2] >= 0xc0 ? buf + 2 : buf[1] >= 0xe0 ? buf + 1 : buf;
+    while (p < end) {
+        uint64_t word;
+        if (end - p >= 8) { // 8 ASCII bytes at a time.
+            std::memcpy(&word, p, sizeof(word));
+            if ((word & 0x8080808080808080ULL) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+        int n = utf8Sequence(p, end);
+        if (n < 0) // the next block has the rest.
+            break;
+        if (n == 0)
+            return static_cast<int>(p - buf) - 3;
+        p += n;
+    }
+    return 64;
+}
+
+inline bool utf8Scalar(const char *block, uint32_t tail) {
+    return utf8Error(block, tail) == 64;
+}
+
+#if NEXTJSON_X86 && (defined(__GNUC__) || defined(__clang__))
+// Every byte is checked against its previous three at once by three table
+// lookups: the high nibble of the previous byte, its low nibble and the
+// high nibble of the byte itself each give the errors they allow, and an
+// error is one bit all three allow. Third and fourth bytes of a sequence
+// are known from the two and three bytes before (Keiser and Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte").
+__attribute__((target("avx2"))) inline bool utf8Avx2(const char *block,
+                                                     uint32_t tail) {
+    // error bits, a bit shared by two errors is told apart by a table.
+    const char kTooShort = 1 << 0;  // lead not followed by a continuation.
+    const char kTooLong = 1 << 1;   // continuation after ASCII.
+    const char kOverlong3 = 1 << 2; // E0 80..9F
+    const char kTooLarge = 1 << 3;  // F4 90..BF, F5..FF
+    const char kSurrogate = 1 << 4; // ED A0..BF
+    const char kOverlong2 = 1 << 5; // C0 and C1.
+    const char kTooLarge1000 = 1 << 6;
+    const char kOverlong4 = 1 << 6; // F0 80..8F
+    const char kTwoConts = char(1 << 7);
+    const char kCarry = kTooShort | kTooLong | kTwoConts;
+
+    const __m256i byte1High = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+        kTooLong, kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+        kTooShort | kOverlong2, kTooShort,
+        kTooShort | kOverlong3 | kSurrogate,
+        kTooShort | kTooLarge | kTooLarge1000 | kOverlong4));
+    const char kLarge = kCarry | kTooLarge | kTooLarge1000;
+    const __m256i byte1Low = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4, kCarry | kOverlong2,
+        kCarry, kCarry, kCarry | kTooLarge, kLarge, kLarge, kLarge, kLarge,
+        kLarge, kLarge, kLarge, kLarge, kLarge | kSurrogate, kLarge,
+        kLarge));
+    const char kCont = kTooLong | kOverlong2 | kTwoConts;
+    const __m256i byte2High = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+        kTooShort, kTooShort,
+        kCont | kOverlong3 | kTooLarge1000 | kOverlong4,
+        kCont | kOverlong3 | kTooLarge, kCont | kSurrogate | kTooLarge,
+        kCont | kSurrogate | kTooLarge, kTooShort, kTooShort, kTooShort,
+        kTooShort));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    __m256i prev = _mm256_insert_epi32(_mm256_setzero_si256(),
+                                       static_cast<int>(tail), 7);
+    __m256i error = _mm256_setzero_si256();
+    for (int i = 0; i < 2; ++i) {
+        __m256i input = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(block + 32 * i));
+        // the bytes 1, 2 and 3 before each.
+        __m256i carried = _mm256_permute2x128_si256(prev, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+        __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+        __m256i special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(
+                    byte1High,
+                    _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(byte1Low,
+                                    _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(
+                byte2High,
+                _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+        // a third or fourth byte has to be a continuation, the only place
+        // two continuations in a row are allowed.
+        __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0x60));
+        __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0x70));
+        __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                          _mm256_set1_epi8(char(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+        prev = input;
+    }
+    return _mm256_testz_si256(error, error);
+}
+#endif
+
+using Utf8Fn = bool (*)(const char *, uint32_t);
+
+// SSE2 has no byte shuffle, NEON blocks are checked as bytes too.
+inline Utf8Fn utf8Validator(SimdLevel level) {
+#if NEXTJSON_X86 && (defined(__GNUC__) || defined(__clang__))
+    if (level == kSimdAvx2)
+        return utf8Avx2;
+#endif
+    (void)level;
+    return utf8Scalar;
+}
+
+// Carried from one 64 byte block to the next.
+struct IndexState {
+    uint64_t prevOdd = 0;      // an odd backslash run ends the block.
+    uint64_t prevInString = 0; // all ones if the block ends in a string.
+    uint64_t prevScalar = 0;   // the block ends in a literal or number.
+    uint32_t utf8Tail = 0;     // see utf8Tail().
+    // offsets of the first error, SIZE_MAX for none.
+    size_t badUtf8 = SIZE_MAX;
+    size_t badControl = SIZE_MAX; // a control character in a string.
+};
+
+// The block at \p base of \p n bytes, a short last block is copied to
+// \p tail padded with spaces so nothing is read past n. \p valid gets the
+// bits of the input bytes.
+inline const char *blockAt(const char *data, size_t n, size_t base,
+                           char *tail, uint64_t &valid) {
+    if (n - base >= 64) {
+        valid = ~uint64_t(0);
+        return data + base;
+    }
+    std::fill(tail, tail + 64, ' ');
+    std::copy(data + base, data + n, tail);
+    valid = (uint64_t(1) << (n - base)) - 1;
+    return tail;
+}
+
+// Masks of the block at \p base of \p n bytes, returns the valid bits.
+inline uint64_t classifyBlock(const char *data, size_t n, size_t base,
+                              ClassifyFn classify, BlockMasks &m) {
+    char tail[64];
+    uint64_t valid;
+    classify(blockAt(data, n, base, tail, valid), m);
+    return valid;
+}
+
+// Write the index of the blocks in [begin, end) of \p data to \p out ,
+// returns past the last entry. \p begin is a multiple of 64. UTF-8 and
+// control characters in strings are checked on the way, \p backslashes
+// gets a flag per block that has a backslash.
+inline uint32_t *indexBlocks(const char *data, size_t n, size_t begin,
+                             size_t end, ClassifyFn classify, Utf8Fn utf8,
+                             IndexState &state, uint32_t *out,
+                             bool *backslashes) {
+    for (size_t base = begin; base < end; base += 64) {
+        BlockMasks m;
+        char tail[64];
+        uint64_t valid;
+        const char *block = blockAt(data, n, base, tail, valid);
+        classify(block, m);
+
+        if ((m.high | state.utf8Tail) && state.badUtf8 == SIZE_MAX) {
+            if (!utf8(block, state.utf8Tail))
+                state.badUtf8 = base + utf8Error(block, state.utf8Tail);
+            state.utf8Tail = utf8Tail(block + 64);
+        }
+
+        backslashes[base / 64] = (m.backslash & valid) != 0;
+        uint64_t escaped = escapedChars(m.backslash, state.prevOdd);
+        uint64_t quote = m.quote & ~escaped;
+        uint64_t inString = prefixXor(quote) ^ state.prevInString;
+        state.prevInString = uint64_t(int64_t(inString) >> 63);
+
+        uint64_t scalar = ~(m.op | m.whitespace);
+        uint64_t nonquoteScalar = scalar & ~quote;
+        uint64_t followsScalar = (nonquoteScalar << 1) | state.prevScalar;
+        state.prevScalar = nonquoteScalar >> 63;
+
+        // inside a string or its closing quote.
+        uint64_t stringTail = inString ^ quote;
+        uint64_t structurals =
+            (((m.op | (scalar & ~followsScalar)) & ~stringTail) | quote) &
+            valid;
+
+        uint64_t control = m.control & inString & valid;
+        if (control && state.badControl == SIZE_MAX)
+            state.badControl = base + trailingZeros(control);
+
+        while (structurals) {
+            *out++ = static_cast<uint32_t>(base + trailingZeros(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+
+    // a sequence cut by the end of input.
+    if (end == n && state.utf8Tail && state.badUtf8 == SIZE_MAX) {
+        uint32_t tail = state.utf8Tail;
+        size_t cut = 3;
+        if (tail >> 24 >= 0xc0)
+            cut = 1;
+        else if ((tail >> 16 & 0xff) >= 0xe0)
+            cut = 2;
+        state.badUtf8 = n - cut;
+    }
+    return out;
+}
+
+// Backslashes right before \p i .
+inline size_t backslashRun(const char *data, size_t i) {
+    size_t run = 0;
+    while (run < i && data[i - 1 - run] == '\\')
+        ++run;
+    return run;
+}
+
+// State at the block boundary \p begin except for prevInString, the other
+// carries only depend on the bytes right before it.
+inline IndexState boundaryState(const char *data, size_t begin) {
+    IndexState state;
+    if (begin == 0)
+        return state;
+    state.prevOdd = backslashRun(data, begin) & 1;
+
+    char ch = data[begin - 1];
+    bool quote = ch == '\"' && (backslashRun(data, begin - 1) & 1) == 0;
+    bool op = std::strchr("{}[]:,", ch) != nullptr;
+    bool whitespace = std::strchr(" \t\n\r", ch) != nullptr;
+    state.prevScalar = ch != '\0' && !quote && !op && !whitespace;
+    state.utf8Tail = begin >= 3 ? utf8Tail(data + begin) : 0;
+    return state;
+}
+
+// Parity of the unescaped quotes in the blocks of [begin, end).
+inline uint64_t quoteParity(const char *data, size_t n, size_t begin,
+                            size_t end, ClassifyFn classify,
+                            uint64_t prevOdd) {
+    uint64_t parity = 0;
+    for (size_t base = begin; base < end; base += 64) {
+        BlockMasks m;
+        uint64_t valid = classifyBlock(data, n, base, classify, m);
+        uint64_t quote = m.quote & ~escapedChars(m.backslash, prevOdd) & valid;
+        parity ^= popCount(quote) & 1;
+    }
+    return parity;
+}
+
+} // namespace detail
+
+/// Structural index of a JSON text (stage 1).
+/// Holds the offset of every structural character ({ } [ ] : ,), of every
+/// unescaped quote, opening and closing, and of the first byte of every
+/// literal and number, in input order. A last entry at the input size
+/// marks the end. Blocks of 64 bytes are classified with simd, the rest is
+/// bit arithmetic on the block bitmaps. Offsets are 32 bits, so the input
+/// is below 4GB.
+class StructuralIndex {
+  public:
+    StructuralIndex()
+        : size_(0), capacity_(0), badUtf8_(SIZE_MAX), badControl_(SIZE_MAX) {}
+
+    /// Index \p n bytes at \p data , returns false if a string is left
+    /// open.
+    bool build(const char *data, size_t n, SimdLevel level = bestSimd()) {
+        assert(n < UINT32_MAX);
+        reserve(n + 1);
+
+        detail::IndexState state;
+        uint32_t *out = detail::indexBlocks(
+            data, n, 0, n, detail::classifier(level),
+            detail::utf8Validator(level), state, positions_.get(),
+            backslashes_.get());
+        *out = static_cast<uint32_t>(n);
+        size_ = out - positions_.get();
+        badUtf8_ = state.badUtf8;
+        badControl_ = state.badControl;
+        return state.prevInString == 0;
+    }
+
+    /// Same index built on every thread of \p pool over chunks of
+    /// \p chunkSize bytes, a multiple of 64 or 0 for a size fit for the
+    /// pool. A first pass takes the quote parity of each chunk, a prefix
+    /// over them gives the string state at each chunk start and a second
+    /// pass indexes the chunks.
+    bool build(const char *data, size_t n, ThreadPool &pool,
+               SimdLevel level = bestSimd(), size_t chunkSize = 0) {
+        const size_t kMinChunk = 1 << 20;
+        if (chunkSize == 0) {
+            chunkSize = std::max(kMinChunk, n / (pool.concurrency() * 4));
+            chunkSize = (chunkSize + 63) & ~size_t(63);
+        }
+        assert(chunkSize % 64 == 0);
+        size_t count = (n + chunkSize - 1) / chunkSize;
+        if (count < 2 || pool.concurrency() == 1)
+            return build(data, n, level);
+
+        assert(n < UINT32_MAX);
+        reserve(n + 1);
+        detail::ClassifyFn classify = detail::classifier(level);
+        detail::Utf8Fn utf8 = detail::utf8Validator(level);
+        std::vector<detail::IndexState> states(count);
+        std::vector<uint64_t> parity(count);
+        pool.run(count, [&](size_t, size_t i) {
+            size_t begin = i * chunkSize, end = std::min(n, begin + chunkSize);
+            states[i] = detail::boundaryState(data, begin);
+            parity[i] = detail::quoteParity(data, n, begin, end, classify,
+                                            states[i].prevOdd);
+        });
+        uint64_t inString = 0;
+        for (size_t i = 0; i < count; ++i) {
+            states[i].prevInString = inString ? ~uint64_t(0) : 0;
+            inString ^= parity[i];
+        }
+
+        // a chunk has fewer entries than bytes, so it is indexed in place
+        // and moved down after.
+        std::vector<size_t> sizes(count);
+        pool.run(count, [&](size_t, size_t i) {
+            size_t begin = i * chunkSize, end = std::min(n, begin + chunkSize);
+            uint32_t *first = positions_.get() + begin;
+            sizes[i] = detail::indexBlocks(data, n, begin, end, classify,
+                                           utf8, states[i], first,
+                                           backslashes_.get()) -
+                       first;
+        });
+        uint32_t *out = positions_.get();
+        badUtf8_ = badControl_ = SIZE_MAX;
+        for (size_t i = 0; i < count; ++i) {
+            std::memmove(out, positions_.get() + i * chunkSize,
+                         sizes[i] * sizeof(uint32_t));
+            out += sizes[i];
+            badUtf8_ = std::min(badUtf8_, states[i].badUtf8);
+            badControl_ = std::min(badControl_, states[i].badControl);
+        }
+
+        *out = static_cast<uint32_t>(n);
+        size_ = out - positions_.get();
+        return inString == 0;
+    }
+
+    /// Number of indexed positions, not counting the end mark.
+    size_t size() const { return size_; }
+    const uint32_t *data() const { return positions_.get(); }
+    uint32_t operator[](size_t i) const { return positions_[i]; }
+
+    /// Offset of the first byte of malformed UTF-8 in the last input,
+    /// SIZE_MAX if there is none.
+    size_t invalidUtf8() const { return badUtf8_; }
+    /// Offset of the first control character inside a string of the last
+    /// input, which JSON wants escaped, SIZE_MAX if there is none.
+    size_t controlCharacter() const { return badControl_; }
+
+    /// False if no byte in [begin, end) of the last input is a backslash,
+    /// true if one may be. Blocks of 64 bytes are flagged, so a string
+    /// does not have to be searched for escapes when none of them is.
+    bool mayHaveBackslash(size_t begin, size_t end) const {
+        if (begin >= end)
+            return false;
+        for (size_t block = begin / 64; block <= (end - 1) / 64; ++block)
+            if (backslashes_[block])
+                return true;
+        return false;
+    }
+
+  private:
+    void reserve(size_t n) {
+        if (n <= capacity_)
+            return;
+        positions_.reset(new uint32_t[n]);
+        backslashes_.reset(new bool[n / 64 + 1]);
+        capacity_ = n;
+    }
+
+    std::unique_ptr<uint32_t[]> positions_;
+    // a flag per 64 byte block, see mayHaveBackslash().
+    std::unique_ptr<bool[]> backslashes_;
+    size_t size_;
+    size_t capacity_;
+    size_t badUtf8_;
+    size_t badControl_;
+};
+
+namespace detail {
+
+// Correctly rounded conversion of [begin, end).
+inline double convertDouble(const char *begin, const char *end,
+                            bool overflow) {
+    double n = 0;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    std::from_chars_result result = std::from_chars(begin, end, n);
+    if (result.ec == std::errc::result_out_of_range) {
+        n = overflow ? HUGE_VAL : 0.0;
+        if (*begin == '-')
+            n = -n;
+    }
+#else
+    // strtod needs a NUL-terminated copy.
+    std::string number(begin, end);
+    n = std::strtod(number.c_str(), NULL);
+    (void)overflow;
+#endif
+    return n;
+}
+
+// Parse the number starting at \p begin into \p number , returns where it
+// ends or nullptr if it is malformed or beyond the range of a double. One
+// pass over the digits: integers are kept exactly, doubles take the exact
+// fast path when they can and std::from_chars otherwise. Nothing is
+// rescanned for integers, errno and the locale are never touched.
+inline const char *parseNumber(const char *begin, const char *end,
+                               Number &number) {
+    const char *p = begin;
+    uint64_t mantissa = 0;
+    int digits = 0;         // significant digits in mantissa.
+    bool truncated = false; // more than 19 significant digits.
+    int64_t exponent = 0;
+
+    auto charAt = [&](const char *q) { return q < end ? *q : '\0'; };
+    auto isDigit = [](char ch) { return ch >= '0' && ch <= '9'; };
+    auto digit = [&](char ch) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (ch - '0');
+            digits += mantissa != 0;
+        } else {
+            truncated = true;
+            ++exponent;
+        }
+    };
+
+    // sign
+    bool negative = charAt(p) == '-';
+    if (negative)
+        ++p;
+
+    // integer
+    if (!isDigit(charAt(p)))
+        return nullptr;
+    if (charAt(p) == '0') { // 0
+        ++p;
+    } else { // 1- 9
+        for (; isDigit(charAt(p)); ++p)
+            digit(*p);
+    }
+    bool integer = true;
+
+    // fractional part
+    if (charAt(p) == '.') {
+        integer = false;
+        ++p;
+        if (!isDigit(charAt(p)))
+            return nullptr;
+        for (; isDigit(charAt(p)); ++p) {
+            if (digits < 19) {
+                digit(*p);
+                --exponent;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+
+    // exponent part
+    if (charAt(p) == 'e' || charAt(p) == 'E') {
+        integer = false;
+        ++p;
+        bool negativeExp = charAt(p) == '-';
+        if (charAt(p) == '+' || charAt(p) == '-')
+            ++p;
+        if (!isDigit(charAt(p)))
+            return nullptr;
+        int64_t exp = 0;
+        for (; isDigit(charAt(p)); ++p)
+            if (exp < 100000)
+                exp = exp * 10 + (*p - '0');
+        exponent += negativeExp ? -exp : exp;
+    }
+
+    if (integer && !truncated) {
+        if (!negative) {
+            number = Number(mantissa);
+            return p;
+        }
+        // -0 has no integer form, it is kept as the double -0.0.
+        if (mantissa != 0 && mantissa <= uint64_t(INT64_MAX) + 1) {
+            number = Number(static_cast<int64_t>(0 - mantissa));
+            return p;
+        }
+    } else if (integer && !negative) {
+        // 20 digits may still fit.
+        uint64_t u;
+        std::from_chars_result result = std::from_chars(begin, p, u);
+        if (result.ec == std::errc()) {
+            number = Number(u);
+            return p;
+        }
+    }
+
+    double n;
+    if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 &&
+        exponent <= 22) {
+        // both operands are exact, so is the one rounding.
+        static const double kPow10[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+            1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+            1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        n = static_cast<double>(mantissa);
+        n = exponent < 0 ? n / kPow10[-exponent] : n * kPow10[exponent];
+        if (negative)
+            n = -n;
+    } else {
+        n = convertDouble(begin, p, exponent > 0);
+    }
+
+    if (n == HUGE_VAL || n == -HUGE_VAL)
+        return nullptr;
+
+    number = Number(n);
+    return p;
+}
+
+} // namespace detail
+
+/// SAX handler accepting and ignoring every event. Handlers derive from it
+/// with CRTP and hide the events they care about. An event returns false
+/// to stop parsing. Strings and keys are only valid during the call.
+template <typename Derived> class BaseHandler {
+  public:
+    bool onNull() { return true; }
+    bool onBool(bool) { return true; }
+    bool onNumber(Number) { return true; }
+    bool onString(String) { return true; }
+    bool onKey(String) { return true; }
+    bool onStartArray() { return true; }
+    bool onEndArray(size_t) { return true; } // elements.
+    bool onStartObject() { return true; }
+    bool onEndObject(size_t) { return true; } // members.
+
+    /// A string, or a key if \p key , as it is between the quotes in the
+    /// input. Escapes, if any, are decoded before onString() or onKey().
+    bool onRawString(std::string_view raw, bool escaped, bool key) {
+        Derived &self = static_cast<Derived &>(*this);
+        String str(raw.data(), raw.size());
+        if (escaped) {
+            // decoding never grows a string.
+            scratch_.resize(raw.size());
+            size_t n = detail::unescape(raw.data(), raw.size(), &scratch_[0]);
+            str = String(scratch_.data(), n);
+        }
+        return key ? self.onKey(str) : self.onString(str);
+    }
+
+  private:
+    std::string scratch_;
+};
+
+namespace detail {
+
+/// SAX handler building the DOM bottom up. Finished values wait on a stack
+/// until their array or object closes and moves them into exactly sized
+/// arena storage, an object takes the key and the value of each member.
+class TreeBuilder : public BaseHandler<TreeBuilder> {
+  public:
+    /// With \p zeroCopy strings are views of the parsed input, see
+    /// \c ParseOptions .
+    TreeBuilder(Arena *arena, bool zeroCopy)
+        : arena_(arena), zeroCopy_(zeroCopy) {}
+
+    void clear() { stack_.clear(); }
+    size_t size() const { return stack_.size(); }
+    void swap(std::vector<Value> &values) { stack_.swap(values); }
+    /// The document, an unknown \c Value if there was nothing to parse.
+    Value take() {
+        if (stack_.empty())
+            return Value();
+        Value value = std::move(stack_.back());
+        stack_.pop_back();
+        return value;
+    }
+
+    bool onNull() { return push(Value(kNull)); }
+    bool onBool(bool b) { return push(Value(b ? kTrue : kFalse)); }
+    bool onNumber(Number number) { return push(Value(number)); }
+    bool onRawString(std::string_view raw, bool escaped, bool) {
+        NEXTJSON_STAT((zeroCopy_ ? stats_.stringBytesViewed
+                                 : stats_.stringBytesCopied) += raw.size());
+        if (!escaped) {
+            const char *p =
+                zeroCopy_ ? raw.data() : arena_->copy(raw.data(), raw.size());
+            return push(Value(p, raw.size(), Value::kVerbatim));
+        }
+
+        if (zeroCopy_)
+            return push(Value(arena_->create<detail::LazyString>(
+                raw.data(), raw.size(), arena_)));
+
+        char *p = static_cast<char *>(arena_->allocate(raw.size() + 1, 1));
+        size_t n = detail::unescape(raw.data(), raw.size(), p);
+        p[n] = '\0';
+        return push(Value(p, n, 0));
+    }
+
+    // The last \p n values become the array taking their place.
+    bool onEndArray(size_t n) {
+        size_t base = stack_.size() - n;
+        Array *array = arena_->create<Array>(arena_);
+        array->values_.assign(stack_.data() + base, n);
+        stack_.resize(base);
+        return push(Value(array));
+    }
+    // The last \p n key, value pairs become the object taking their place.
+    bool onEndObject(size_t n) {
+        size_t base = stack_.size() - n * 2;
+        Value *first = stack_.data() + base;
+        Object *obj = arena_->create<Object>(arena_);
+        obj->memberList_.reserve(n);
+        for (size_t i = 0; i < n * 2; i += 2)
+            obj->memberList_.push_back(
+                Object::member_t(std::move(first[i]), std::move(first[i + 1])));
+        stack_.resize(base);
+        return push(Value(obj));
+    }
+
+    /// Values and string bytes built, see \c ParseStats .
+    ParseStats &stats() { return stats_; }
+    const ParseStats &stats() const { return stats_; }
+
+  private:
+    bool push(Value &&value) {
+        NEXTJSON_STAT(++stats_.nodes[value.type()]);
+        stack_.push_back(std::move(value));
+        return true;
+    }
+
+    Arena *arena_;
+    bool zeroCopy_;
+    std::vector<Value> stack_;
+    ParseStats stats_;
+};
+
+} // namespace detail
+
+/// Parser options.
+struct ParseOptions {
+    /// Keep strings and keys as views into the input, which then has to
+    /// outlive the parsed values. Escaped strings are decoded on first read.
+    bool zeroCopy = false;
+    /// Deepest nesting of arrays and objects accepted.
+    size_t maxDepth = 1024;
+};
+
+// What a parse failed on.
+enum ParseError : uint8_t {
+    kNoError,
+    kUnterminatedString,
+    kUnexpectedEnd,
+    kExpectedValue,
+    kExpectedKey,
+    kExpectedColon,
+    kExpectedCommaOrEnd,
+    kInvalidLiteral,
+    kInvalidNumber,
+    kInvalidEscape,
+    kInvalidUtf8,
+    kControlCharacter,
+    kTooDeep,
+    kTrailingCharacters,
+    kTypeMismatch
+};
+
+static const char *ParseErrorName[15] = {
+    "No error",
+    "Unterminated string",
+    "Unexpected end",
+    "Expected a value",
+    "Expected a key",
+    "Expected ':'",
+    "Expected ',' or a closing bracket",
+    "Invalid literal",
+    "Invalid number",
+    "Invalid escape",
+    "Invalid UTF-8",
+    "Unescaped control character",
+    "Nesting too deep",
+    "Trailing characters",
+    "Value does not fit the type"};
+
+/// Stringify parse error \p error .
+inline const char *errorToString(ParseError error) {
+    return ParseErrorName[error];
+}
+
+/// Outcome of a parse: the error and the byte offset it was found at. Line
+/// and column are counted from the input only when asked for, which has to
+/// be alive then, so a parse that succeeds never pays for them. A handler
+/// that stopped a parse is not an error.
+class ParseResult {
+  public:
+    ParseResult() : error_(kNoError), offset_(0) {}
+    ParseResult(ParseError error, size_t offset, std::string_view input)
+        : error_(error), offset_(offset), input_(input) {}
+
+    bool ok() const { return error_ == kNoError; }
+    explicit operator bool() const { return ok(); }
+    ParseError error() const { return error_; }
+    size_t offset() const { return offset_; }
+
+    /// 1-based line of the error, 0 if the input was not kept.
+    size_t line() const {
+        if (input_.empty())
+            return 0;
+        size_t end = std::min(offset_, input_.size());
+        return 1 + std::count(input_.begin(), input_.begin() + end, '\n');
+    }
+    /// 1-based column in bytes, 0 if the input was not kept.
+    size_t column() const {
+        if (input_.empty())
+            return 0;
+        size_t end = std::min(offset_, input_.size());
+        size_t newline =
+            end == 0 ? std::string_view::npos : input_.rfind('\n', end - 1);
+        return newline == std::string_view::npos ? end + 1 : end - newline;
+    }
+
+    /// "Expected ':' at line 2, column 7".
+    std::string message() const {
+        std::string str = errorToString(error_);
+        if (ok())
+            return str;
+        char buf[64];
+        if (input_.empty())
+            std::snprintf(buf, sizeof(buf), " at offset %zu", offset_);
+        else
+            std::snprintf(buf, sizeof(buf), " at line %zu, column %zu",
+                          line(), column());
+        return str + buf;
+    }
+
+  private:
+    ParseError error_;
+    size_t offset_;
+    std::string_view input_;
+};
+
+namespace detail {
+
+/// The first malformed UTF-8 sequence or raw control character in a
+/// string that \p index met, at \p offset . \c kNoError if there is none.
+inline ParseError invalidBytes(const StructuralIndex &index, size_t &offset) {
+    size_t utf8 = index.invalidUtf8(), control = index.controlCharacter();
+    offset = std::min(utf8, control);
+    if (utf8 < control)
+        return kInvalidUtf8;
+    return control != SIZE_MAX ? kControlCharacter : kNoError;
+}
+
+/// Walks the tokens of the structural index of an input, shared by the
+/// parsers that read a whole document.
+class TokenReader {
+  protected:
+    TokenReader(const char *data, size_t n, size_t maxDepth)
+        : view_(data, n), source_(&index_), cursor_(nullptr),
+          error_(kNoError), errorOffset_(0), maxDepth_(maxDepth) {}
+
+    std::string_view view_;
+    // structural index of view_, whitespace is never visited.
+    StructuralIndex index_;
+    // the index cursor_ walks, index_ or one built elsewhere.
+    const StructuralIndex *source_;
+    const uint32_t *cursor_;
+    // the first error of the last parse.
+    ParseError error_;
+    size_t errorOffset_;
+    // counters of the last parse.
+    ParseStats stats_;
+    // open arrays and objects, at most maxDepth_ .
+    struct Frame {
+        size_t count; // elements or members so far.
+        ValueType type;
+    };
+    std::vector<Frame> frames_;
+    size_t maxDepth_;
+
+    // Index the input and point at its first token, false if a string is
+    // left open or the input has a byte no string may hold.
+    bool start() {
+        error_ = kNoError;
+        NEXTJSON_STAT(uint64_t begin = detail::statClock());
+        bool closed = index_.build(view_.data(), view_.size());
+        NEXTJSON_STAT(stats_.scanNanos += detail::statClock() - begin;
+                      stats_.bytesScanned += view_.size());
+        source_ = &index_;
+        cursor_ = index_.data();
+        // nothing in the open string is indexed, its quote comes last.
+        if (!closed)
+            return fail(kUnterminatedString, index_[index_.size() - 1]);
+        size_t offset;
+        ParseError error = invalidBytes(index_, offset);
+        return error == kNoError || fail(error, offset);
+    }
+
+    ParseResult result() const {
+        return ParseResult(error_, errorOffset_, view_);
+    }
+
+    // Record \p error at \p offset , always false so that a failed step
+    // returns it.
+    bool fail(ParseError error, size_t offset) {
+        error_ = error;
+        errorOffset_ = offset;
+        return false;
+    }
+    // \p error at the current token, which may be the end of input.
+    bool fail(ParseError error) {
+        return fail(atEnd() ? kUnexpectedEnd : error, position());
+    }
+
+    size_t position() const { return *cursor_; }
+    bool atEnd() const { return position() == view_.size(); }
+    const char *token() const { return view_.data() + position(); }
+    char peek() const { return atEnd() ? '\0' : *token(); }
+    char next() {
+        char ch = peek();
+        if (!atEnd())
+            ++cursor_;
+        return ch;
+    }
+    // Consume \p ch , or fail with \p error on any other token.
+    bool expect(char ch, ParseError error) {
+        if (peek() != ch)
+            return fail(error);
+        ++cursor_;
+        return true;
+    }
+
+    // A scalar has to be followed by whitespace, a structural character or
+    // the end of input.
+    bool isScalarEnd(size_t i) const {
+        if (i >= view_.size())
+            return true;
+        switch (view_[i]) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case ',':
+        case ':':
+        case ']':
+        case '}':
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool parseLiteral(const char *literal, size_t n) {
+        size_t begin = position();
+        if (view_.compare(begin, n, literal) != 0 || !isScalarEnd(begin + n))
+            return fail(kInvalidLiteral, begin);
+        next();
+        return true;
+    }
+
+    bool parseNumber(Number &number) {
+        const char *end = view_.data() + view_.size();
+        const char *p = detail::parseNumber(token(), end, number);
+        if (!p || !isScalarEnd(p - view_.data()))
+            return fail(kInvalidNumber, position());
+        next();
+        return true;
+    }
+
+    // String body between the quotes at the current token into \p out ,
+    // the closing quote is the next structural once start() found every
+    // string closed. \p escaped is set if the body has any escape, false
+    // if one of them is malformed.
+    bool scanString(std::string_view &out, bool &escaped) {
+        size_t begin = *cursor_++ + 1;
+        size_t end = *cursor_++;
+        out = std::string_view(view_.data() + begin, end - begin);
+        escaped = false;
+        // most strings have no backslash near them and skip the search.
+        return !source_->mayHaveBackslash(begin, end) ||
+               scanEscapes(out, escaped);
+    }
+    // Out of line so that scanString() stays small enough to inline.
+    NEXTJSON_NOINLINE bool scanEscapes(std::string_view str, bool &escaped) {
+        const char *slash = static_cast<const char *>(
+            std::memchr(str.data(), '\\', str.size()));
+        escaped = slash != nullptr;
+        if (escaped) {
+            const char *bad = detail::invalidEscape(
+                slash, str.data() + str.size() - slash);
+            if (bad)
+                return fail(kInvalidEscape, bad - view_.data());
+        }
+        return true;
+    }
+
+    // One value with everything in it, shared by the parsers. Each open
+    // array or object is a frame on frames_, so memory grows with the
+    // nesting depth only.
+    template <typename Handler> bool parseValue(Handler &handler) {
+        frames_.clear();
+        for (;;) {
+            // a value, a container is left open on frames_.
+            switch (peek()) {
+            case '[':
+                if (!openContainer(handler, kArray))
+                    return false;
+                if (peek() != ']')
+                    continue;
+                if (!closeContainer(handler)) // empty.
+                    return false;
+                break;
+            case '{':
+                if (!openContainer(handler, kObject))
+                    return false;
+                if (peek() != '}') {
+                    if (!parseKey(handler))
+                        return false;
+                    continue;
+                }
+                if (!closeContainer(handler)) // empty.
+                    return false;
+                break;
+            default:
+                if (!parseScalar(handler))
+                    return false;
+            }
+
+            // close containers until one takes another value.
+            for (;;) {
+                if (frames_.empty())
+                    return true;
+                ++frames_.back().count;
+                if (peek() == ',') {
+                    next();
+                    if (frames_.back().type == kObject && !parseKey(handler))
+                        return false;
+                    break;
+                }
+                if (!closeContainer(handler))
+                    return false;
+            }
+        }
+    }
+
+    // A failed step returns false whether the input is malformed or the
+    // handler stopped, error_ is only set for the former.
+    template <typename Handler> bool parseScalar(Handler &handler) {
+        switch (peek()) {
+        case 'n':
+            return parseLiteral("null", 4) && handler.onNull();
+        case 'f':
+            return parseLiteral("false", 5) && handler.onBool(false);
+        case 't':
+            return parseLiteral("true", 4) && handler.onBool(true);
+        case '\"': {
+            bool escaped = false;
+            std::string_view str;
+            return scanString(str, escaped) &&
+                   handler.onRawString(str, escaped, false);
+        }
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9': {
+            Number number(0);
+            return parseNumber(number) && handler.onNumber(number);
+        }
+        default:
+            return fail(kExpectedValue);
+        }
+    }
+
+    // '[' or '{'
+    template <typename Handler>
+    bool openContainer(Handler &handler, ValueType type) {
+        if (frames_.size() >= maxDepth_)
+            return fail(kTooDeep, position());
+        next();
+        frames_.push_back(Frame{0, type});
+        NEXTJSON_STAT(stats_.maxDepth =
+                          std::max<uint64_t>(stats_.maxDepth, frames_.size()));
+        return type == kArray ? handler.onStartArray()
+                              : handler.onStartObject();
+    }
+
+    // ']' or '}'
+    template <typename Handler> bool closeContainer(Handler &handler) {
+        Frame frame = frames_.back();
+        frames_.pop_back();
+        if (!expect(frame.type == kArray ? ']' : '}', kExpectedCommaOrEnd))
+            return false;
+        return frame.type == kArray ? handler.onEndArray(frame.count)
+                                    : handler.onEndObject(frame.count);
+    }
+
+    // string ':'
+    template <typename Handler> bool parseKey(Handler &handler) {
+        if (peek() != '\"')
+            return fail(kExpectedKey);
+        bool escaped = false;
+        std::string_view key;
+        if (!scanString(key, escaped) || !expect(':', kExpectedColon))
+            return false;
+        return handler.onRawString(key, escaped, true);
+    }
+};
+
+} // namespace detail
+
+class Parser : private detail::TokenReader {
+  public:
+    /// Nodes, strings and child lists are all carved from \p arena .
+    Parser(const char *data, size_t n, Arena *arena,
+           ParseOptions options = ParseOptions())
+        : TokenReader(data, n, options.maxDepth),
+          options_(options),
+          builder_(arena, options.zeroCopy) {
+        frames_.reserve(std::min<size_t>(options_.maxDepth, 256));
+    }
+
+    /// Rebind to new input, the index and the scratch stack keep their
+    /// capacity.
+    void reset(const char *data, size_t n) {
+        view_ = std::string_view(data, n);
+        cursor_ = nullptr;
+    }
+
+    /// Parse element, an unknown \c Value on failure, see \c result() .
+    Value parse() {
+        builder_.clear();
+        if (!parse(builder_)) {
+            builder_.clear();
+            return Value();
+        }
+        return builder_.take();
+    }
+
+    /// Drive \p handler with the events of the document instead of building
+    /// it, nothing is allocated once the parser is warm. Returns false if
+    /// the input is malformed or the handler stopped, \c result() tells
+    /// which.
+    template <typename Handler> bool parse(Handler &handler) {
+#if NEXTJSON_STATS
+        stats_ = builder_.stats() = ParseStats();
+        uint64_t begin = detail::statClock();
+        bool ok = parseDocument(handler);
+        stats_.buildNanos = detail::statClock() - begin - stats_.scanNanos;
+        return ok;
+#else
+        return parseDocument(handler);
+#endif
+    }
+
+    /// Error of the last parse, offsets count from the start of the input.
+    using TokenReader::result;
+
+    /// Counters of the last parse, see \c ParseStats .
+    ParseStats stats() const {
+        ParseStats stats = stats_;
+        stats.add(builder_.stats());
+        return stats;
+    }
+
+    /// Parse \p count elements, or members if \p members , at entry
+    /// \p first of \p index , an index of the whole input built elsewhere,
+    /// and append them to \p out , the key and the value of each member.
+    /// The last one has to be followed by ',' or the closing bracket.
+    /// Returns false on malformed input.
+    bool parseRange(const StructuralIndex &index, size_t first, size_t count,
+                    bool members, std::vector<Value> &out) {
+        error_ = kNoError;
+        source_ = &index;
+        cursor_ = index.data() + first;
+        builder_.clear();
+        builder_.swap(out);
+        bool ok = true;
+        for (size_t i = 0; i < count; ++i) {
+            ok = (!members || parseKey(builder_)) && parseValue(builder_);
+            if (!ok)
+                break;
+            if (peek() == ',') {
                 next();
+            } else if (i + 1 < count || peek() != (members ? '}' : ']')) {
+                ok = fail(kExpectedCommaOrEnd);
+                break;
+            }
+        }
+        builder_.swap(out);
+        return ok;
+    }
+
+  private:
+    ParseOptions options_;
+    detail::TreeBuilder builder_;
+
+    // Iterative value parser. Each open array or object is a frame on
+    // frames_, so memory grows with the nesting depth only.
+    template <typename Handler> bool parseDocument(Handler &handler) {
+        error_ = kNoError;
+        if (view_.size() == 0) // no value at all.
+            return true;
+        if (!start())
+            return false;
+        if (atEnd()) // whitespace only.
+            return true;
+
+        if (!parseValue(handler))
+            return false;
+        if (!atEnd())
+            return fail(kTrailingCharacters, position());
+        return true;
+    }
+};
+
+namespace detail {
+
+/// SAX handler writing the tape of a \c BinaryDocument in document order.
+/// A container is closed by its offset table, taken from the entries
+/// recorded while it was open.
+class TapeBuilder : public BaseHandler<TapeBuilder> {
+  public:
+    TapeBuilder() { clear(); }
+
+    void clear() {
+        words_.assign(1, BinaryDocument::kMagic);
+        open_.clear();
+        entries_.clear();
+    }
+    const std::vector<uint64_t> &words() const { return words_; }
+
+    bool onNull() { return literal(kNull); }
+    bool onBool(bool b) { return literal(b ? kTrue : kFalse); }
+    bool onNumber(Number number) {
+        element();
+        uint64_t bits;
+        if (number.isInt64()) {
+            bits = static_cast<uint64_t>(number.getInt64());
+        } else if (number.isUint64()) {
+            bits = number.getUint64();
+        } else {
+            double d = number.getNumber();
+            std::memcpy(&bits, &d, sizeof(bits));
+        }
+        head(kNumber, 0, number.type());
+        words_.push_back(bits);
+        return true;
+    }
+    /// Escapes are decoded straight onto the tape, a string without any is
+    /// also its JSON source.
+    bool onRawString(std::string_view raw, bool escaped, bool key) {
+        return string(raw, escaped, key, !escaped);
+    }
+    /// \p raw is decoded if \p escaped , \p verbatim if the result needs no
+    /// escaping in JSON.
+    bool string(std::string_view raw, bool escaped, bool key, bool verbatim) {
+        if (key)
+            entry();
+        else
+            element();
+        size_t at = words_.size();
+        head(kString, 0, verbatim);
+        // the last word holds the NUL and the padding.
+        words_.resize(at + 1 + raw.size() / sizeof(uint64_t) + 1);
+        words_.back() = 0;
+        char *p = reinterpret_cast<char *>(&words_[at + 1]);
+        size_t n = raw.size();
+        if (escaped) {
+            // decoding never grows a string, the surplus words go.
+            n = detail::unescape(raw.data(), raw.size(), p);
+            size_t words = n / sizeof(uint64_t) + 1;
+            words_.resize(at + 1 + words);
+            std::memset(p + n, 0, words * sizeof(uint64_t) - n);
+        } else {
+            std::memcpy(p, raw.data(), n);
+        }
+        words_[at] |= uint64_t(n) << 32;
+        return true;
+    }
+    bool onStartArray() { return open(kArray); }
+    bool onStartObject() { return open(kObject); }
+    bool onEndArray(size_t n) { return close(n); }
+    bool onEndObject(size_t n) { return close(n); }
+
+  private:
+    void head(ValueType type, size_t count, uint8_t sub = 0) {
+        assert(count <= UINT32_MAX);
+        words_.push_back(uint64_t(type) | uint64_t(sub) << 8 |
+                         uint64_t(count) << 32);
+    }
+
+    // A value starts, it is an entry of an open array, in an object the key
+    // is the entry.
+    void element() {
+        if (!open_.empty() && (words_[open_.back()] & 0xff) == kArray)
+            entry();
+    }
+    void entry() {
+        if (open_.empty())
+            return;
+        assert(words_.size() - open_.back() <= UINT32_MAX);
+        entries_.push_back(static_cast<uint32_t>(words_.size() - open_.back()));
+    }
+
+    bool literal(ValueType type) {
+        element();
+        head(type, 0);
+        return true;
+    }
+
+    bool open(ValueType type) {
+        element();
+        open_.push_back(words_.size());
+        head(type, 0);
+        words_.push_back(0); // the content size.
+        return true;
+    }
+
+    // The offset table of the last \p n entries ends the container.
+    bool close(size_t n) {
+        size_t at = open_.back();
+        open_.pop_back();
+        size_t table = words_.size();
+        words_.resize(table + (n + 1) / 2, 0);
+        if (n > 0)
+            std::memcpy(&words_[table], entries_.data() + entries_.size() - n,
+                        n * sizeof(uint32_t));
+        entries_.resize(entries_.size() - n);
+        assert(n <= UINT32_MAX);
+        words_[at] |= uint64_t(n) << 32;
+        words_[at + 1] = words_.size() - at - 2;
+        return true;
+    }
+
+    std::vector<uint64_t> words_;
+    std::vector<size_t> open_;       // heads of the open containers.
+    std::vector<uint32_t> entries_;  // offsets in the open containers.
+};
+
+} // namespace detail
+
+/// Binary encoding of a value tree, the tape described at
+/// \c BinaryDocument , which reads it back in place without parsing.
+class BinaryWriter {
+  public:
+    /// Replace the output with the encoding of \p root .
+    void write(const Value &root) {
+        tape_.clear();
+        if (root.type() != kUnknown)
+            writeValue(root);
+    }
+
+    const char *data() const {
+        return reinterpret_cast<const char *>(tape_.words().data());
+    }
+    size_t size() const { return tape_.words().size() * sizeof(uint64_t); }
+
+  private:
+    void writeValue(const Value &value) {
+        switch (value.type()) {
+        case kNull:
+            tape_.onNull();
+            break;
+        case kFalse:
+        case kTrue:
+            tape_.onBool(value.getBool());
+            break;
+        case kNumber:
+            tape_.onNumber(value.getNumber());
+            break;
+        case kString:
+            writeString(value, false);
+            break;
+        case kArray: {
+            const Array &array = value.getArray();
+            tape_.onStartArray();
+            for (const Value &element : array)
+                writeValue(element);
+            tape_.onEndArray(array.size());
+            break;
+        }
+        case kObject: {
+            const Object &obj = value.getObject();
+            tape_.onStartObject();
+            for (const Object::member_t &member : obj) {
+                writeString(member.first, true);
+                writeValue(member.second);
+            }
+            tape_.onEndObject(obj.size());
+            break;
+        }
+        case kUnknown:
+            break;
+        }
+    }
+    void writeString(const Value &str, bool key) {
+        String raw = str.getRawString();
+        if (raw.data())
+            tape_.string(raw.view(), false, key, true);
+        else
+            tape_.string(str.getString().view(), false, key, false);
+    }
+
+    detail::TapeBuilder tape_;
+};
+
+/// DOM stored as one tape in document order, see \c BinaryDocument . Each
+/// container records its size and an offset table, so skipping a subtree
+/// and reaching an element are O(1) and a traversal, formatting included,
+/// scans memory forward. Strings are decoded onto the tape, the input can
+/// go once parsed. The tape is also the binary encoding as it is, so
+/// \c data() can be saved and mapped back by \c BinaryDocument .
+class TapeDocument {
+  public:
+    TapeDocument(const char *data, ParseOptions options = ParseOptions())
+        : TapeDocument(data, std::char_traits<char>::length(data), options) {}
+    TapeDocument(const char *data, size_t n,
+                 ParseOptions options = ParseOptions())
+        : parser_(data, n, nullptr, options) {}
+
+    /// On failure the tape is empty, so is the root.
+    ParseResult parse() {
+        tape_.clear();
+        if (!parser_.parse(tape_))
+            tape_.clear();
+        return parser_.result();
+    }
+
+    /// Rebind to new input, the tape keeps its capacity.
+    void reset(const char *data, size_t n) {
+        tape_.clear();
+        parser_.reset(data, n);
+    }
+
+    /// The document, unknown if it is empty.
+    BinaryValue root() const {
+        const std::vector<uint64_t> &words = tape_.words();
+        return words.size() > 1 ? BinaryValue(words.data() + 1)
+                                : BinaryValue();
+    }
+
+    const char *data() const {
+        return reinterpret_cast<const char *>(tape_.words().data());
+    }
+    size_t size() const { return tape_.words().size() * sizeof(uint64_t); }
+
+  private:
+    Parser parser_; // its tree builder is not used.
+    detail::TapeBuilder tape_;
+};
+
+/// Incremental SAX parser for input that arrives in pieces, such as a
+/// chunked HTTP body. Chunks of any size are fed in order and the state is
+/// kept across them, even in the middle of a string or a number. Only a
+/// token split by a chunk boundary is buffered, so parsing overlaps
+/// receiving. Events are the same as \c Parser sends to \p Handler , raw
+/// strings may point into a chunk or a scratch buffer.
+template <typename Handler> class BasicPushParser {
+  public:
+    explicit BasicPushParser(Handler &handler,
+                             ParseOptions options = ParseOptions())
+        : handler_(handler), options_(options) {
+        reset();
+    }
+
+    /// Start over on a new document.
+    void reset() {
+        state_ = kValue;
+        key_ = escape_ = escaped_ = false;
+        token_.clear();
+        frames_.clear();
+        chunk_ = nullptr;
+        offset_ = tokenAt_ = 0;
+        error_ = kNoError;
+        errorOffset_ = 0;
+    }
+
+    /// Parse the next \p n bytes of the document. Returns false once the
+    /// handler stopped or the input turned out malformed, later input is
+    /// ignored.
+    bool feed(const char *data, size_t n) {
+        const char *p = data, *end = data + n;
+        chunk_ = data;
+        while (p < end && state_ < kStopped) {
+            if (state_ == kString)
+                p = feedString(p, end);
+            else if (state_ == kScalar)
+                p = feedScalar(p, end);
+            else
+                p = feedStructural(p, end);
+        }
+        offset_ += n;
+        return state_ < kStopped;
+    }
+    bool feed(std::string_view data) { return feed(data.data(), data.size()); }
+
+    /// True once a whole value has been read.
+    bool done() const { return state_ == kDone; }
+
+    /// End of input, empty input is no value at all. Returns false if the
+    /// handler stopped or the input is malformed or cut short.
+    bool finish() {
+        if (state_ == kScalar) {
+            endScalar(token_.data(), token_.size());
+            token_.clear();
+        }
+        if (state_ == kString)
+            fail(kUnterminatedString, tokenAt_);
+        else if (state_ < kStopped && state_ != kDone &&
+                 !(state_ == kValue && frames_.empty()))
+            fail(kUnexpectedEnd, offset_);
+        return state_ < kStopped;
+    }
+
+    /// Error of the input so far, offsets count from the first byte fed.
+    /// Chunks are not kept, so there is no line or column.
+    ParseResult result() const {
+        return ParseResult(error_, errorOffset_, std::string_view());
+    }
+
+  private:
+    // Where the input is in the grammar.
+    enum State : uint8_t {
+        kValue,      // a value.
+        kValueOrEnd, // a value or ']' after '['.
+        kKey,        // a key after ',' in an object.
+        kKeyOrEnd,   // a key or '}' after '{'.
+        kColon,      // ':' after a key.
+        kNext,       // ',' or the end of the open container.
+        kDone,       // trailing whitespace.
+        kString,     // inside a string, token_ has its start.
+        kScalar,     // inside a number or a literal, token_ has its start.
+        kStopped,    // the handler returned false.
+        kError,      // malformed input, see error_.
+    };
+
+    struct Frame {
+        size_t count; // elements or members so far.
+        ValueType type;
+    };
+
+    Handler &handler_;
+    ParseOptions options_;
+    State state_;
+    bool key_;     // the string is a key.
+    bool escape_;  // the last string character was an escaping backslash.
+    bool escaped_; // the string has escapes.
+    std::string token_;
+    std::vector<Frame> frames_;
+    const char *chunk_; // the chunk being fed.
+    size_t offset_;     // bytes fed before chunk_.
+    size_t tokenAt_;    // offset of the string or scalar token_ belongs to.
+    ParseError error_;
+    size_t errorOffset_;
+
+    // Offset of \p p in the chunk being fed.
+    size_t offsetOf(const char *p) const { return offset_ + (p - chunk_); }
+
+    void fail(ParseError error, size_t offset) {
+        state_ = kError;
+        error_ = error;
+        errorOffset_ = offset;
+    }
+    // Fail at \p p , the chunk is consumed.
+    const char *fail(ParseError error, const char *p, const char *end) {
+        fail(error, offsetOf(p));
+        return end;
+    }
+
+    static bool isWhitespace(char ch) {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+    }
+    static bool isScalarEnd(char ch) {
+        return isWhitespace(ch) || ch == ',' || ch == ':' || ch == ']' ||
+               ch == '}';
+    }
+
+    const char *feedStructural(const char *p, const char *end) {
+        while (p < end && isWhitespace(*p))
+            ++p;
+        if (p == end)
+            return p;
+
+        char ch = *p;
+        switch (state_) {
+        case kValueOrEnd:
+            if (ch == ']')
+                return closeContainer(p, end, kArray);
+            // fall through
+        case kValue:
+            return beginValue(p, end);
+        case kKeyOrEnd:
+            if (ch == '}')
+                return closeContainer(p, end, kObject);
+            // fall through
+        case kKey:
+            if (ch != '\"')
+                return fail(kExpectedKey, p, end);
+            key_ = true;
+            tokenAt_ = offsetOf(p);
+            state_ = kString;
+            return p + 1;
+        case kColon:
+            if (ch != ':')
+                return fail(kExpectedColon, p, end);
+            state_ = kValue;
+            return p + 1;
+        case kNext:
+            if (ch == ',') {
+                state_ = frames_.back().type == kObject ? kKey : kValue;
+                return p + 1;
+            }
+            return closeContainer(p, end, frames_.back().type);
+        default:
+            return fail(kTrailingCharacters, p, end);
+        }
+    }
+
+    const char *beginValue(const char *p, const char *end) {
+        switch (*p) {
+        case '[':
+        case '{': {
+            ValueType type = *p == '[' ? kArray : kObject;
+            if (frames_.size() >= options_.maxDepth)
+                return fail(kTooDeep, p, end);
+            frames_.push_back(Frame{0, type});
+            state_ = type == kArray ? kValueOrEnd : kKeyOrEnd;
+            bool ok = type == kArray ? handler_.onStartArray()
+                                     : handler_.onStartObject();
+            if (!ok)
+                state_ = kStopped;
+            return p + 1;
+        }
+        case '\"':
+            key_ = false;
+            tokenAt_ = offsetOf(p);
+            state_ = kString;
+            return p + 1;
+        default:
+            if (isScalarEnd(*p))
+                return fail(kExpectedValue, p, end);
+            tokenAt_ = offsetOf(p);
+            state_ = kScalar;
+            return p;
+        }
+    }
+
+    const char *closeContainer(const char *p, const char *end,
+                               ValueType type) {
+        if (*p != (type == kArray ? ']' : '}'))
+            return fail(kExpectedCommaOrEnd, p, end);
+        size_t count = frames_.back().count;
+        frames_.pop_back();
+        endValue(type == kArray ? handler_.onEndArray(count)
+                                : handler_.onEndObject(count));
+        return p + 1;
+    }
+
+    // A value went to the handler, which returned \p ok .
+    void endValue(bool ok) {
+        if (!ok) {
+            state_ = kStopped;
+        } else if (frames_.empty()) {
+            state_ = kDone;
+        } else {
+            ++frames_.back().count;
+            state_ = kNext;
+        }
+    }
+
+    // Up to the closing quote, which is consumed.
+    const char *feedString(const char *p, const char *end) {
+        const char *begin = p;
+        for (;;) {
+            if (escape_) { // the character after a backslash.
+                if (p == end)
+                    break;
+                ++p;
+                escape_ = false;
+            }
+            const char *quote =
+                static_cast<const char *>(std::memchr(p, '\"', end - p));
+            const char *stop = quote ? quote : end;
+            const char *slash =
+                static_cast<const char *>(std::memchr(p, '\\', stop - p));
+            if (!slash) {
+                p = stop;
+                break;
+            }
+            escape_ = escaped_ = true;
+            p = slash + 1;
+        }
+
+        if (p == end) {
+            token_.append(begin, p - begin);
+            return p;
+        }
+        if (token_.empty()) {
+            endString(std::string_view(begin, p - begin));
+        } else {
+            token_.append(begin, p - begin);
+            endString(token_);
+            token_.clear();
+        }
+        return p + 1;
+    }
+
+    void endString(std::string_view raw) {
+        bool escaped = escaped_;
+        escaped_ = false;
+        if (!checkString(raw, escaped))
+            return;
+        bool ok = handler_.onRawString(raw, escaped, key_);
+        if (!key_)
+            endValue(ok);
+        else
+            state_ = ok ? kColon : kStopped;
+    }
+
+    // Strings are seen without a structural index here, so the bytes of
+    // the whole body are checked at once.
+    bool checkString(std::string_view raw, bool escaped) {
+        auto p = reinterpret_cast<const uint8_t *>(raw.data());
+        const uint8_t *begin = p, *end = p + raw.size();
+        while (p < end) {
+            if (*p < 0x20) {
+                fail(kControlCharacter, tokenAt_ + 1 + (p - begin));
+                return false;
+            }
+            int n = detail::utf8Sequence(p, end);
+            if (n <= 0) {
+                fail(kInvalidUtf8, tokenAt_ + 1 + (p - begin));
+                return false;
+            }
+            p += n;
+        }
+        const char *bad =
+            escaped ? detail::invalidEscape(raw.data(), raw.size()) : nullptr;
+        if (bad)
+            fail(kInvalidEscape, tokenAt_ + 1 + (bad - raw.data()));
+        return !bad;
+    }
+
+    // Up to the character after the scalar, which is not consumed.
+    const char *feedScalar(const char *p, const char *end) {
+        const char *begin = p;
+        while (p < end && !isScalarEnd(*p))
+            ++p;
+
+        if (p == end) {
+            token_.append(begin, p - begin);
+        } else if (token_.empty()) {
+            endScalar(begin, p - begin);
+        } else {
+            token_.append(begin, p - begin);
+            endScalar(token_.data(), token_.size());
+            token_.clear();
+        }
+        return p;
+    }
+
+    void endScalar(const char *str, size_t n) {
+        std::string_view scalar(str, n);
+        if (scalar == "null")
+            return endValue(handler_.onNull());
+        if (scalar == "true")
+            return endValue(handler_.onBool(true));
+        if (scalar == "false")
+            return endValue(handler_.onBool(false));
+        if (*str == 'n' || *str == 't' || *str == 'f')
+            return fail(kInvalidLiteral, tokenAt_);
+
+        Number number(0);
+        const char *p = detail::parseNumber(str, str + n, number);
+        if (p != str + n)
+            return fail(kInvalidNumber, tokenAt_);
+        endValue(handler_.onNumber(number));
+    }
+};
+
+/// Incremental DOM parser, see \c BasicPushParser . Strings are always
+/// copied into the arena since chunks do not outlive feed().
+class PushParser {
+  public:
+    explicit PushParser(Arena *arena, ParseOptions options = ParseOptions())
+        : builder_(arena, false), parser_(builder_, options) {}
+
+    void reset() {
+        builder_.clear();
+        parser_.reset();
+    }
+    /// False once the input is malformed.
+    bool feed(const char *data, size_t n) { return parser_.feed(data, n); }
+    bool feed(std::string_view data) { return parser_.feed(data); }
+    bool done() const { return parser_.done(); }
+
+    /// End of input, returns the document. An unknown \c Value stands for
+    /// empty input or an error, see \c result() .
+    Value finish() {
+        if (!parser_.finish()) {
+            builder_.clear();
+            return Value();
+        }
+        return builder_.take();
+    }
+    ParseResult result() const { return parser_.result(); }
+
+  private:
+    detail::TreeBuilder builder_;
+    BasicPushParser<detail::TreeBuilder> parser_;
+};
+
+/// JSON
+/// Threading: once parsed, any number of threads may read one document
+/// concurrently through const references. Const reads only ever fill caches,
+/// the object key index and decoded strings, and those are published lock
+/// free. Parsing, \c reset() , \c format() and any non-const access need
+/// the document to themselves. Copies of heap values share containers with
+/// an atomic count and may be used from any thread.
+class Document {
+  public:
+    Document() : Document("", 0) {}
+    Document(const char *data, ParseOptions options = ParseOptions())
+        : Document(data, std::char_traits<char>::length(data), options) {}
+    Document(const char *data, size_t n, ParseOptions options = ParseOptions())
+        : data_(data, n), parser_(data, n, &arena_, options) {}
+    Document(const FileStream &input, ParseOptions options = ParseOptions())
+        : Document(input.data(), input.size(), options) {}
+
+    /// On failure the root is unknown and the result tells what went wrong
+    /// and where.
+    ParseResult parse() {
+        NEXTJSON_STAT(size_t blocks = arena_.blocks());
+        rootValue_ = parser_.parse();
+        NEXTJSON_STAT(ParseStats stats = parser_.stats();
+                      stats.arenaBlocks = arena_.blocks() - blocks;
+                      collect(stats));
+        return parser_.result();
+    }
+
+    /// Drop the parsed tree and the output, and rebind to new input. The
+    /// arena, the structural index, the parser stacks and the output buffer
+    /// keep their capacity, so a reused \c Document does not go back to the
+    /// system allocator once it is warm.
+    void reset(const char *data, size_t n) {
+        rootValue_ = Value();
+        arena_.reset();
+        formatter_.clear();
+        data_ = std::string_view(data, n);
+        parser_.reset(data, n);
+    }
+    void reset(const char *data) {
+        reset(data, std::char_traits<char>::length(data));
+    }
+
+    /// The output replaces that of the last format().
+    void format() {
+        NEXTJSON_STAT(uint64_t begin = detail::statClock());
+        formatter_.clear();
+        formatter_.format(rootValue_);
+        NEXTJSON_STAT(ParseStats stats;
+                      stats.formatNanos = detail::statClock() - begin;
+                      collect(stats));
+    }
+    void format(const FormatOptions &options) {
+        formatter_.setOptions(options);
+        format();
+    }
+
+    const Value &root() const { return rootValue_; }
+    /// The parsed tree to edit in place. Its arrays and objects live in the
+    /// arena and are not shared, so edits do not copy them. Values set on
+    /// them are copied into the arena unless they live there, and what is
+    /// removed is only freed by reset(). A heap value put at the root is
+    /// owned by the document. After snapshot() the tree is on the heap and
+    /// shared, an edit then copies the path it changes. Valid until the
+    /// next parse() or reset().
+    Value &root() { return rootValue_; }
+
+    /// A copy of the root that shares its arrays and objects. The first call
+    /// moves the tree out of the arena into reference counted heap nodes,
+    /// later ones cost O(1), so a snapshot per request is nearly free. The
+    /// arena copy is only freed by reset().
+    Value snapshot() {
+        if ((rootValue_.isArray() || rootValue_.isObject()) &&
+            !rootValue_.isOwned())
+            rootValue_ = Value(rootValue_, nullptr);
+        return rootValue_;
+    }
+    const Formatter &formatter() const { return formatter_; }
+    const Arena &arena() const { return arena_; }
+    /// Counters of every parse and format since construction, which also
+    /// go to \c ParseStats::thread() .
+    const ParseStats &stats() const { return stats_; }
+
+  private:
+    void collect(const ParseStats &stats) {
+        stats_.add(stats);
+        ParseStats::thread().add(stats);
+    }
+
+    std::string_view data_;
+    Arena arena_; // owns every node of rootValue_.
+    Value rootValue_;
+    Parser parser_;
+    Formatter formatter_;
+    ParseStats stats_;
+};
+
+/// Warm documents kept for reuse, so that parsing one request after another
+/// stops allocating once the documents have grown to fit the inputs. A pool
+/// and its documents belong to one thread, \c local() is the pool of the
+/// calling thread. Handles must not outlive their pool.
+class DocumentPool {
+  public:
+    /// Gives a document back to its pool.
+    struct Release {
+        DocumentPool *pool;
+        void operator()(Document *doc) const { pool->release(doc); }
+    };
+    using Handle = std::unique_ptr<Document, Release>;
+
+    explicit DocumentPool(ParseOptions options = ParseOptions())
+        : options_(options) {}
+
+    /// A document bound to \p n bytes at \p data , an idle one if there is
+    /// any.
+    Handle acquire(const char *data, size_t n) {
+        if (idle_.empty())
+            return Handle(new Document(data, n, options_), Release{this});
+        Document *doc = idle_.back().release();
+        idle_.pop_back();
+        doc->reset(data, n);
+        return Handle(doc, Release{this});
+    }
+    Handle acquire(std::string_view data) {
+        return acquire(data.data(), data.size());
+    }
+
+    /// Documents waiting for acquire().
+    size_t idle() const { return idle_.size(); }
+
+    /// The pool of the calling thread, with default options.
+    static DocumentPool &local() {
+        thread_local DocumentPool pool;
+        return pool;
+    }
+
+  private:
+    // the tree goes now, the capacity stays.
+    void release(Document *doc) {
+        doc->reset("", 0);
+        idle_.emplace_back(doc);
+    }
+
+    ParseOptions options_;
+    std::vector<std::unique_ptr<Document>> idle_;
+};
+
+/// Newline delimited JSON (NDJSON, JSON Lines) parsed in parallel. A raw
+/// newline cannot occur inside a JSON string, so every '\n' ends a record
+/// and splitting is a memchr scan. Empty lines are skipped. Records go to
+/// the threads of a \c ThreadPool in batches, each thread parses with its
+/// own warm \c Parser and \c Arena .
+class NdjsonParser {
+  public:
+    explicit NdjsonParser(ThreadPool &pool,
+                          ParseOptions options = ParseOptions())
+        : pool_(pool), options_(options) {
+        for (size_t i = 0; i < pool.concurrency(); ++i)
+            workers_.emplace_back(new Worker(options));
+    }
+
+    /// Parse every record of \p n bytes at \p data into its own root.
+    /// Roots stay valid until the next parse(), zero-copy ones as long as
+    /// the input. A malformed record has an unknown root, the result is
+    /// the first of them.
+    ParseResult parse(const char *data, size_t n) {
+        split(data, n);
+        roots_.clear();
+        roots_.resize(records_.size());
+        for (std::unique_ptr<Worker> &worker : workers_)
+            worker->arena.reset();
+
+        forEachRecord([this](size_t worker, size_t i) {
+            Worker &w = *workers_[worker];
+            w.parser.reset(records_[i].data(), records_[i].size());
+            roots_[i] = w.parser.parse();
+            w.check(i);
+        });
+        collect(data, n);
+        return result_;
+    }
+
+    /// Send the events of every record to handlers[worker], records of one
+    /// thread arrive in order but the threads run concurrently. Needs one
+    /// handler per thread of the pool. Returns false if a handler stopped
+    /// or a record is malformed, that thread then skips its other records.
+    template <typename Handler>
+    bool parse(const char *data, size_t n, std::vector<Handler> &handlers) {
+        assert(handlers.size() >= pool_.concurrency());
+        split(data, n);
+
+        forEachRecord([&](size_t worker, size_t i) {
+            Worker &w = *workers_[worker];
+            w.parser.reset(records_[i].data(), records_[i].size());
+            if (!w.stopped && !w.parser.parse(handlers[worker])) {
+                w.stopped = true;
+                w.check(i);
+            }
+        });
+        bool ok = true;
+        for (std::unique_ptr<Worker> &worker : workers_) {
+            ok = ok && !worker->stopped;
+            worker->stopped = false;
+        }
+        collect(data, n);
+        return ok;
+    }
+
+    /// The first malformed record of the last parse, its offset counts
+    /// from the start of the whole input, so the line is the record's.
+    const ParseResult &result() const { return result_; }
+
+    /// Records of the last input, spanning their line without the
+    /// newline.
+    size_t size() const { return records_.size(); }
+    std::string_view record(size_t i) const { return records_[i]; }
+    /// Root of record \p i after parse() without handlers.
+    const Value &operator[](size_t i) const { return roots_[i]; }
+
+  private:
+    // A thread's parser, which builds into the thread's arena.
+    struct Worker {
+        explicit Worker(ParseOptions options)
+            : parser("", 0, &arena, options), stopped(false),
+              failed(kNone) {}
+
+        // Keep the error of record \p i if it is the first one.
+        void check(size_t i) {
+            if (i < failed && !parser.result().ok()) {
+                failed = i;
+                error = parser.result();
+            }
+        }
+
+        Arena arena;
+        Parser parser;
+        bool stopped;
+        size_t failed; // first malformed record, kNone if none.
+        ParseResult error;
+    };
+
+    static constexpr size_t kNone = SIZE_MAX;
+
+    // The first error of all workers into result_, offset into the input.
+    void collect(const char *data, size_t n) {
+        const Worker *first = nullptr;
+        for (std::unique_ptr<Worker> &worker : workers_)
+            if (worker->failed != kNone &&
+                (!first || worker->failed < first->failed))
+                first = worker.get();
+        result_ = ParseResult();
+        if (first) {
+            size_t at = records_[first->failed].data() - data;
+            result_ = ParseResult(first->error.error(),
+                                  at + first->error.offset(),
+                                  std::string_view(data, n));
+        }
+        for (std::unique_ptr<Worker> &worker : workers_)
+            worker->failed = kNone;
+    }
+
+    void split(const char *data, size_t n) {
+        records_.clear();
+        const char *p = data, *end = data + n;
+        while (p < end) {
+            const char *line =
+                static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!line)
+                line = end;
+            size_t size = line - p;
+            if (size > 0 && p[size - 1] == '\r')
+                --size;
+            if (size > 0)
+                records_.push_back(std::string_view(p, size));
+            p = line + 1;
+        }
+    }
+
+    // fn(worker, record) for every record, batches keep the counter cold.
+    template <typename Fn> void forEachRecord(Fn fn) {
+        size_t n = records_.size();
+        size_t batch = std::max<size_t>(1, n / (pool_.concurrency() * 16));
+        pool_.run((n + batch - 1) / batch, [&](size_t worker, size_t task) {
+            size_t end = std::min(n, (task + 1) * batch);
+            for (size_t i = task * batch; i < end; ++i)
+                fn(worker, i);
+        });
+    }
+
+    ThreadPool &pool_;
+    ParseOptions options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::string_view> records_;
+    std::vector<Value> roots_;
+    ParseResult result_;
+};
+
+/// Document parsed on every thread of a \c ThreadPool . The structural
+/// index is built over chunks in parallel, then the elements of a top
+/// level array, or the members of a top level object, are split into
+/// groups of about equal size which threads build into their own arenas.
+/// The groups are stitched into one root in order, the tree is the same
+/// as \c Document builds. Other documents are parsed on the calling
+/// thread.
+class ParallelDocument {
+  public:
+    ParallelDocument(ThreadPool &pool, const char *data, size_t n,
+                     ParseOptions options = ParseOptions())
+        : pool_(pool), data_(data, n), options_(options) {
+        for (size_t i = 0; i < pool.concurrency(); ++i) {
+            arenas_.emplace_back(new Arena());
+            parsers_.emplace_back(
+                new Parser(data, n, arenas_.back().get(), options));
+        }
+    }
+    ParallelDocument(ThreadPool &pool, const FileStream &input,
+                     ParseOptions options = ParseOptions())
+        : ParallelDocument(pool, input.data(), input.size(), options) {}
+
+    /// On failure the root is unknown, the error is the first one in the
+    /// input.
+    ParseResult parse() {
+        rootValue_ = Value();
+        for (std::unique_ptr<Arena> &arena : arenas_)
+            arena->reset();
+
+        if (!index_.build(data_.data(), data_.size(), pool_))
+            return ParseResult(kUnterminatedString, index_[index_.size() - 1],
+                               data_);
+        size_t offset;
+        ParseError error = detail::invalidBytes(index_, offset);
+        if (error != kNoError)
+            return ParseResult(error, offset, data_);
+        char first = index_.size() > 0 ? data_[index_[0]] : '\0';
+        if (first != '[' && first != '{') {
+            parsers_[0]->reset(data_.data(), data_.size());
+            rootValue_ = parsers_[0]->parse();
+            return parsers_[0]->result();
+        }
+
+        // the first entry of every top level element or member. Brackets
+        // below the top level are matched by the parsers.
+        starts_.clear();
+        size_t depth = 0, last = 0;
+        // the end of input is the last entry.
+        auto token = [&](size_t i) {
+            return index_[i] < data_.size() ? data_[index_[i]] : '\0';
+        };
+        for (size_t i = 0; i < index_.size(); ++i) {
+            if (depth == 0 && i > 0)
+                return ParseResult(kTrailingCharacters, index_[i], data_);
+            switch (token(i)) {
+            case '[':
+            case '{':
+                if (depth++ == 0 && token(i + 1) != first + 2)
+                    starts_.push_back(i + 1);
+                break;
+            case ']':
+            case '}':
+                if (--depth == 0) {
+                    // ']' and '}' follow '[' and '{' by two in ASCII.
+                    if (token(i) != first + 2)
+                        return ParseResult(kExpectedCommaOrEnd, index_[i],
+                                           data_);
+                    last = i;
+                }
+                break;
+            case ',':
+                if (depth == 1)
+                    starts_.push_back(i + 1);
+                break;
+            }
+        }
+        if (depth > 0)
+            return ParseResult(kUnexpectedEnd, data_.size(), data_);
+
+        // groups of about the same number of index entries.
+        size_t groups = pool_.concurrency() * 4;
+        bounds_.assign(1, 0);
+        for (size_t i = 1; i < starts_.size(); ++i)
+            if (starts_[i] * groups / last != starts_[i - 1] * groups / last)
+                bounds_.push_back(i);
+        if (!starts_.empty())
+            bounds_.push_back(starts_.size());
+
+        std::vector<std::vector<Value>> values(bounds_.size() - 1);
+        std::vector<ParseResult> results(values.size());
+        bool members = first == '{';
+        pool_.run(values.size(), [&](size_t worker, size_t g) {
+            size_t begin = bounds_[g], count = bounds_[g + 1] - begin;
+            Parser &parser = *parsers_[worker];
+            if (!parser.parseRange(index_, starts_[begin], count, members,
+                                   values[g]))
+                results[g] = parser.result();
+        });
+        for (const ParseResult &result : results)
+            if (!result.ok())
+                return result;
+
+        detail::TreeBuilder builder(arenas_[0].get(), options_.zeroCopy);
+        std::vector<Value> all;
+        all.reserve(starts_.size() * (members ? 2 : 1));
+        for (std::vector<Value> &group : values)
+            for (Value &value : group)
+                all.push_back(std::move(value));
+        builder.swap(all);
+        if (members)
+            builder.onEndObject(starts_.size());
+        else
+            builder.onEndArray(starts_.size());
+        rootValue_ = builder.take();
+        return ParseResult();
+    }
+
+    const Value &root() const { return rootValue_; }
+
+  private:
+    ThreadPool &pool_;
+    std::string_view data_;
+    ParseOptions options_;
+    StructuralIndex index_;
+    std::vector<size_t> starts_; // index entry of each top level child.
+    std::vector<size_t> bounds_; // first child of each group.
+    // one per thread, arenas_[0] also holds the root container.
+    std::vector<std::unique_ptr<Arena>> arenas_;
+    std::vector<std::unique_ptr<Parser>> parsers_;
+    Value rootValue_;
+};
+
+class LazyDocument;
+
+/// Value of a \c LazyDocument , a position in its structural index. Reading
+/// a value only touches its own tokens, a missing member or element and a
+/// malformed literal or number are unknown values. Valid as long as the
+/// document and its input.
+class LazyValue {
+  public:
+    LazyValue() : doc_(nullptr), index_(kNone) {}
+
+    ValueType type() const;
+    bool isNull() const { return type() == kNull; }
+    bool isBool() const { return type() == kTrue || type() == kFalse; }
+    bool isNumber() const { return type() == kNumber; }
+    bool isString() const { return type() == kString; }
+    bool isArray() const { return type() == kArray; }
+    bool isObject() const { return type() == kObject; }
+
+    bool getBool() const;
+    Number getNumber() const;
+    /// A view of the input. An escaped string is decoded into the document
+    /// arena on its first read and the copy is reused after, threads may
+    /// read the same string at once.
+    String getString() const;
+
+    /// Elements of an array or members of an object, counted by skipping
+    /// over them.
+    size_t size() const;
+    /// Element \p i of an array, unread elements before it are skipped.
+    LazyValue operator[](size_t i) const;
+    /// Value of \p key in an object, the first member wins when a key
+    /// repeats.
+    LazyValue operator[](std::string_view key) const;
+
+    /// Build this subtree as a \c Value in the document arena, strings are
+    /// views of the input.
+    Value materialize() const;
+
+  private:
+    friend class LazyDocument;
+    friend class Splice;
+
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    LazyValue(const LazyDocument *doc, uint32_t index)
+        : doc_(doc), index_(index) {}
+
+    const char *token(uint32_t index) const;
+    // Index entry just past the value at \p index .
+    uint32_t skip(uint32_t index) const;
+    // Raw string between the quotes at \p index and the next entry.
+    std::string_view rawString(uint32_t index) const;
+    // Whether only whitespace is left from \p p to the next entry, false
+    // for null.
+    bool scalar(const char *p) const;
+    bool literal(std::string_view name) const;
+    Number number(bool &ok) const;
+
+    const LazyDocument *doc_;
+    uint32_t index_; // in the structural index, kNone if missing.
+};
+
+/// Document read on demand. parse() only indexes the input and checks the
+/// order of its tokens, values are read when a path reaches them and arrays and
+/// objects on the way are skipped in one step each, so nothing is built
+/// for what is never read. Scalars are checked when read. The input has to
+/// outlive the document.
+class LazyDocument {
+  public:
+    LazyDocument(const char *data, ParseOptions options = ParseOptions())
+        : LazyDocument(data, std::char_traits<char>::length(data), options) {}
+    LazyDocument(const char *data, size_t n,
+                 ParseOptions options = ParseOptions())
+        : data_(data, n), options_(options) {}
+    LazyDocument(const FileStream &input,
+                 ParseOptions options = ParseOptions())
+        : LazyDocument(input.data(), input.size(), options) {}
+
+    /// Only the structure is checked here, the contents of scalars are
+    /// checked when read. On failure the root is unknown.
+    ParseResult parse() {
+        match_.clear();
+        decoded_.store(nullptr, std::memory_order_relaxed);
+        if (!index_.build(data_.data(), data_.size()))
+            return ParseResult(kUnterminatedString, index_[index_.size() - 1],
+                               data_);
+        size_t offset;
+        ParseError error = detail::invalidBytes(index_, offset);
+        if (error != kNoError)
+            return fail(error, offset);
+
+        // matching brackets, index of the closing one at the opening one,
+        // and the order of the tokens around them.
+        size_t n = index_.size();
+        match_.resize(n);
+        open_.clear();
+        Expect expect = kValue;
+        bool empty = false; // just after an opening bracket.
+        for (uint32_t i = 0; i < n; ++i) {
+            char ch = data_[index_[i]];
+            switch (ch) {
+            case '[':
+            case '{':
+                if (expect != kValue)
+                    return fail(expected(expect), index_[i]);
+                if (open_.size() >= options_.maxDepth)
+                    return fail(kTooDeep, index_[i]);
+                open_.push_back(i);
+                expect = ch == '{' ? kKey : kValue;
+                empty = true;
+                continue;
+            case ']':
+            case '}': {
+                if (open_.empty())
+                    return fail(i == 0 ? kExpectedValue : kTrailingCharacters,
+                                index_[i]);
+                uint32_t open = open_.back();
+                // ']' and '}' follow '[' and '{' by two in ASCII.
+                if (data_[index_[open]] + 2 != ch)
+                    return fail(kExpectedCommaOrEnd, index_[i]);
+                if (expect != kNext && !empty)
+                    return fail(expected(expect), index_[i]);
+                open_.pop_back();
+                match_[open] = i;
+                expect = kNext;
+                break;
+            }
+            case ':':
+                if (expect != kColon)
+                    return fail(expected(expect), index_[i]);
+                expect = kValue;
+                break;
+            case ',':
+                if (expect != kNext || open_.empty())
+                    return fail(expected(expect), index_[i]);
+                expect = data_[index_[open_.back()]] == '{' ? kKey : kValue;
+                break;
+            case '\"':
+                if (expect != kKey && expect != kValue)
+                    return fail(expected(expect), index_[i]);
+                expect = expect == kKey ? kColon : kNext;
+                ++i; // the closing quote.
+                break;
+            default:
+                if (expect != kValue)
+                    return fail(expected(expect), index_[i]);
+                expect = kNext;
+                break;
+            }
+            empty = false;
+        }
+        if (!open_.empty())
+            return fail(kUnexpectedEnd, data_.size());
+        return ParseResult();
+    }
+
+    /// Drop everything read and rebind to new input, buffers keep their
+    /// capacity.
+    void reset(const char *data, size_t n) {
+        arena_.reset();
+        decoded_.store(nullptr, std::memory_order_relaxed);
+        data_ = std::string_view(data, n);
+        match_.clear();
+    }
+
+    /// The document, unknown if it is empty.
+    LazyValue root() const {
+        return index_.size() > 0 && !match_.empty() ? LazyValue(this, 0)
+                                                    : LazyValue();
+    }
+    const Arena &arena() const { return arena_; }
+
+  private:
+    friend class LazyValue;
+    friend class Splice;
+
+    // next token in parse().
+    enum Expect { kValue, kKey, kColon, kNext };
+
+    ParseResult fail(ParseError error, size_t offset) {
+        match_.clear();
+        return ParseResult(error, offset, data_);
+    }
+
+    // The escaped string \p raw at index entry \p i decoded, once per
+    // entry. Readers racing on it decode the same characters and the first
+    // copy published wins, like a \c detail::LazyString .
+    String decoded(uint32_t i, std::string_view raw) const;
+
+    ParseError expected(Expect expect) const {
+        switch (expect) {
+        case kValue:
+            return kExpectedValue;
+        case kKey:
+            return kExpectedKey;
+        case kColon:
+            return kExpectedColon;
+        default:
+            return open_.empty() ? kTrailingCharacters : kExpectedCommaOrEnd;
+        }
+    }
+
+    std::string_view data_;
+    ParseOptions options_;
+    StructuralIndex index_;
+    std::vector<uint32_t> match_; // closing bracket of an opening one.
+    std::vector<uint32_t> open_;  // open brackets while matching.
+    mutable Arena arena_;         // decoded strings and materialized trees.
+    // decoded() copies by index entry, the length ahead of the characters.
+    // Allocated on the first escaped string read.
+    mutable std::atomic<std::atomic<const char *> *> decoded_{nullptr};
+};
+
+inline String LazyDocument::decoded(uint32_t i, std::string_view raw) const {
+    using Slot = std::atomic<const char *>;
+    Slot *slots = decoded_.load(std::memory_order_acquire);
+    if (!slots) {
+        size_t n = index_.size();
+        Slot *fresh =
+            static_cast<Slot *>(arena_.allocateShared(n * sizeof(Slot)));
+        for (size_t k = 0; k < n; ++k)
+            new (fresh + k) Slot(nullptr);
+        if (decoded_.compare_exchange_strong(slots, fresh,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire))
+            slots = fresh;
+    }
+
+    const char *str = slots[i].load(std::memory_order_acquire);
+    if (!str) {
+        char *p = static_cast<char *>(
+            arena_.allocateShared(sizeof(size_t) + raw.size() + 1));
+        size_t n =
+            detail::unescape(raw.data(), raw.size(), p + sizeof(size_t));
+        std::memcpy(p, &n, sizeof(n));
+        p[sizeof(size_t) + n] = '\0';
+        if (slots[i].compare_exchange_strong(str, p,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire))
+            str = p;
+    }
+    size_t n;
+    std::memcpy(&n, str, sizeof(n));
+    return String(str + sizeof(size_t), n);
+}
+
+inline const char *LazyValue::token(uint32_t index) const {
+    return doc_->data_.data() + doc_->index_[index];
+}
+
+inline uint32_t LazyValue::skip(uint32_t index) const {
+    switch (*token(index)) {
+    case '[':
+    case '{':
+        return doc_->match_[index] + 1;
+    case '\"':
+        return index + 2;
+    default:
+        return index + 1;
+    }
+}
+
+inline std::string_view LazyValue::rawString(uint32_t index) const {
+    const char *begin = token(index) + 1;
+    return std::string_view(begin, token(index + 1) - begin);
+}
+
+inline bool LazyValue::scalar(const char *p) const {
+    if (!p)
+        return false;
+    for (const char *end = token(index_ + 1); p < end; ++p)
+        if (!std::strchr(" \t\n\r", *p))
+            return false;
+    return true;
+}
+
+inline bool LazyValue::literal(std::string_view name) const {
+    const char *p = token(index_);
+    if (static_cast<size_t>(token(index_ + 1) - p) < name.size())
+        return false;
+    return std::memcmp(p, name.data(), name.size()) == 0 &&
+           scalar(p + name.size());
+}
+
+inline Number LazyValue::number(bool &ok) const {
+    Number number(0);
+    ok = scalar(detail::parseNumber(token(index_), token(index_ + 1), number));
+    return number;
+}
+
+inline ValueType LazyValue::type() const {
+    if (index_ == kNone)
+        return kUnknown;
+    switch (*token(index_)) {
+    case 'n':
+        return literal("null") ? kNull : kUnknown;
+    case 't':
+        return literal("true") ? kTrue : kUnknown;
+    case 'f':
+        return literal("false") ? kFalse : kUnknown;
+    case '\"':
+        return kString;
+    case '[':
+        return kArray;
+    case '{':
+        return kObject;
+    default: {
+        bool ok;
+        number(ok);
+        return ok ? kNumber : kUnknown;
+    }
+    }
+}
+
+inline bool LazyValue::getBool() const {
+    assert(isBool());
+    return *token(index_) == 't';
+}
+
+inline Number LazyValue::getNumber() const {
+    bool ok;
+    Number n = number(ok);
+    assert(ok && "Invalid number");
+    return n;
+}
+
+inline String LazyValue::getString() const {
+    assert(isString());
+    std::string_view raw = rawString(index_);
+    if (!std::memchr(raw.data(), '\\', raw.size()))
+        return String(raw.data(), raw.size());
+    return doc_->decoded(index_, raw);
+}
+
+inline size_t LazyValue::size() const {
+    assert(isArray() || isObject());
+    uint32_t end = doc_->match_[index_];
+    size_t n = 0;
+    for (uint32_t i = index_ + 1; i < end; ++n) {
+        if (isObject())
+            i += 3; // key and ':'.
+        i = skip(i);
+        i += *token(i) == ','; // before the next one.
+    }
+    return n;
+}
+
+inline LazyValue LazyValue::operator[](size_t index) const {
+    assert(isArray());
+    uint32_t end = doc_->match_[index_];
+    uint32_t i = index_ + 1;
+    for (; i < end && index > 0; --index) {
+        i = skip(i);
+        i += *token(i) == ',';
+    }
+    return i < end ? LazyValue(doc_, i) : LazyValue();
+}
+
+inline LazyValue LazyValue::operator[](std::string_view key) const {
+    assert(isObject());
+    uint32_t end = doc_->match_[index_];
+    for (uint32_t i = index_ + 1; i < end;) {
+        std::string_view raw = rawString(i);
+        bool found = raw == key;
+        if (!found && std::memchr(raw.data(), '\\', raw.size())) {
+            std::string name(raw.size(), '\0');
+            name.resize(detail::unescape(raw.data(), raw.size(), &name[0]));
+            found = name == key;
         }
+        if (found)
+            return LazyValue(doc_, i + 3);
 
-        // fractional part
-        if (peek() == '.') {
-            do {
-                next();
-            } while (isdigit(peek()));
+        i = skip(i + 3);
+        i += *token(i) == ',';
+    }
+    return LazyValue();
+}
+
+inline Value LazyValue::materialize() const {
+    if (index_ == kNone)
+        return Value();
+
+    size_t begin = doc_->index_[index_];
+    size_t end = doc_->index_[skip(index_)];
+    if (isArray() || isObject() || isString())
+        end = doc_->index_[skip(index_) - 1] + 1; // the closing character.
+
+    ParseOptions options = doc_->options_;
+    options.zeroCopy = true;
+    Parser parser(doc_->data_.data() + begin, end - begin, &doc_->arena_,
+                  options);
+    return parser.parse();
+}
+
+
+/// Compiled RFC 6901 JSON Pointer such as "/items/3/price", "" is the whole
+/// document. Keys are unescaped and hashed once so a lookup in an indexed
+/// object does not hash them again, numeric segments also index arrays.
+/// A malformed pointer has no segments and finds nothing.
+class Pointer {
+  public:
+    explicit Pointer(std::string_view pointer) : ok_(valid(pointer)) {
+        while (ok_ && !pointer.empty()) {
+            pointer.remove_prefix(1);
+            size_t n = pointer.find('/');
+            std::string key;
+            for (size_t i = 0; i < n && i < pointer.size(); ++i) {
+                char ch = pointer[i];
+                if (ch == '~') {
+                    ch = pointer[++i] == '0' ? '~' : '/';
+                }
+                key += ch;
+            }
+            add(std::move(key));
+            pointer.remove_prefix(std::min(n, pointer.size()));
         }
+    }
 
-        // exponent part
-        if (peek() == 'e' || peek() == 'E')
-            next();
-        if (peek() == '+' || peek() == '-')
-            next();
-        while (isdigit(peek()))
-            next();
+    /// Dotted path such as "items[3].price", the same as the pointer
+    /// "/items/3/price". Keys can not contain '.' or '['.
+    static Pointer path(std::string_view path) {
+        Pointer pointer("");
+        size_t i = 0;
+        while (i < path.size()) {
+            size_t n = path.find_first_of(".[]", i);
+            n = n == std::string_view::npos ? path.size() : n;
+            if (n > i)
+                pointer.add(std::string(path.substr(i, n - i)));
+            i = n + 1;
+        }
+        return pointer;
+    }
 
-        // convert string to number.
-        double n = std::strtod(begin, NULL);
+    /// Whether \p pointer is well formed.
+    static bool valid(std::string_view pointer) {
+        if (!pointer.empty() && pointer[0] != '/')
+            return false;
+        for (size_t i = 0; i < pointer.size(); ++i) {
+            char next = i + 1 < pointer.size() ? pointer[i + 1] : '\0';
+            if (pointer[i] == '~' && next != '0' && next != '1')
+                return false;
+        }
+        return true;
+    }
 
-        assert(errno != ERANGE && (n != HUGE_VAL && n != -HUGE_VAL));
+    /// False if the pointer string was malformed.
+    bool ok() const { return ok_; }
+    /// Segments, a key of each step.
+    size_t size() const { return segments_.size(); }
+    std::string_view operator[](size_t i) const { return segments_[i].key; }
+    /// Array index of segment \p i , SIZE_MAX if the key is none.
+    size_t index(size_t i) const { return segments_[i].index; }
 
-        Value value(ValueType::kNumber, Number(n));
-        return value;
+    /// Value at the pointer under \p root , null if there is none.
+    const Value *find(const Value &root) const { return find(root, 0); }
+
+    /// Value at segment \p first and on under \p value .
+    const Value *find(const Value &value, size_t first) const {
+        const Value *v = ok_ ? &value : nullptr;
+        for (size_t i = first; v && i < segments_.size(); ++i) {
+            const Segment &segment = segments_[i];
+            if (v->isObject()) {
+                v = v->getObject().find(segment.key, segment.hash);
+            } else if (v->isArray()) {
+                const Array &array = v->getArray();
+                v = segment.index < array.size() ? &array[segment.index]
+                                                 : nullptr;
+            } else {
+                v = nullptr;
+            }
+        }
+        return v;
+    }
+
+    /// Lazy lookup, only the arrays and objects on the path are entered.
+    LazyValue find(LazyValue v) const {
+        if (!ok_)
+            return LazyValue();
+        for (const Segment &segment : segments_) {
+            if (v.isObject())
+                v = v[segment.key];
+            else if (v.isArray() && segment.index != kNoIndex)
+                v = v[segment.index];
+            else
+                return LazyValue();
+        }
+        return v;
     }
 
-    Value parseString() {
-        assert(next() == '\"');
+    /// Whether segment \p i selects key \p key or element \p index .
+    bool matchKey(size_t i, std::string_view key) const {
+        return segments_[i].key == key;
+    }
+    bool matchIndex(size_t i, size_t index) const {
+        return segments_[i].index == index;
+    }
 
-        const char *begin = token();
+  private:
+    static constexpr size_t kNoIndex = SIZE_MAX;
 
-        do {
-            if (peek() == '\\') {
-                switch (next()) {
-                case '\"':
-                    break;
-                case '\\':
-                    break;
-                case '/':
-                    break;
-                case 'b':
-                    break;
-                case 'f':
-                    break;
-                case 'n':
-                    break;
-                case 'r':
-                    break;
-                case 't':
-                    break;
-                default:
-                    // FIME: 4 hex digits.
-                    // check(true, peek(), "Legal escape character");
-                    ;
-                }
-            } else if (peek() == '\"') {
-                break;
+    struct Segment {
+        std::string key;
+        uint32_t hash;
+        size_t index; // kNoIndex if the key is not an array index.
+    };
+
+    void add(std::string key) {
+        Segment segment{std::move(key), 0, kNoIndex};
+        segment.hash = detail::hashKey(segment.key.data(), segment.key.size());
+        // no leading zeros, "-" is past the end and never found.
+        const std::string &k = segment.key;
+        if (!k.empty() && (k[0] != '0' || k.size() == 1)) {
+            size_t index = 0;
+            const char *end = k.data() + k.size();
+            auto result = std::from_chars(k.data(), end, index);
+            if (result.ec == std::errc() && result.ptr == end)
+                segment.index = index;
+        }
+        segments_.push_back(std::move(segment));
+    }
+
+    std::vector<Segment> segments_;
+    bool ok_;
+};
+
+/// SAX handler reading the values of several pointers in one pass, parsing
+/// stops as soon as each pointer is found or known to be absent. Only the
+/// values found are built, in \p arena , everything else is streamed past.
+///
+///   PointerQuery query({Pointer("/user/id"), Pointer("/items/3")}, &arena);
+///   parser.parse(query);
+///   const Value *id = query[0];
+class PointerQuery : public BaseHandler<PointerQuery> {
+  public:
+    PointerQuery(std::vector<Pointer> pointers, Arena *arena)
+        : pointers_(std::move(pointers)),
+          arena_(arena),
+          builder_(arena, false) {
+        clear();
+    }
+
+    /// Start over on a new document.
+    void clear() {
+        size_t n = pointers_.size();
+        results_.assign(n, nullptr);
+        resolved_.assign(n, false);
+        matched_.assign(n, 0);
+        unresolved_ = n;
+        for (size_t i = 0; i < n; ++i)
+            if (!pointers_[i].ok())
+                resolve(i, nullptr);
+        frames_.clear();
+        builder_.clear();
+        capture_ = false;
+    }
+
+    size_t size() const { return pointers_.size(); }
+    /// Value of pointer \p i , null if absent or not read yet.
+    const Value *operator[](size_t i) const { return results_[i]; }
+    /// Every pointer is found or known to be absent.
+    bool done() const { return unresolved_ == 0; }
+
+    bool onNull() {
+        return scalar([this] { builder_.onNull(); });
+    }
+    bool onBool(bool b) {
+        return scalar([this, b] { builder_.onBool(b); });
+    }
+    bool onNumber(Number number) {
+        return scalar([this, number] { builder_.onNumber(number); });
+    }
+    bool onRawString(std::string_view raw, bool escaped, bool key) {
+        if (key)
+            return onRawKey(raw, escaped);
+        return scalar([this, raw, escaped] {
+            builder_.onRawString(raw, escaped, false);
+        });
+    }
+    bool onStartArray() { return open(true); }
+    bool onStartObject() { return open(false); }
+    bool onEndArray(size_t n) {
+        if (!capture_)
+            return leave();
+        builder_.onEndArray(n);
+        return close();
+    }
+    bool onEndObject(size_t n) {
+        if (!capture_)
+            return leave();
+        builder_.onEndObject(n);
+        return close();
+    }
+
+  private:
+    // An open array or object on the way, outside of a captured value.
+    struct Frame {
+        bool array;
+        size_t index; // of the next element.
+    };
+
+    std::vector<Pointer> pointers_;
+    std::vector<const Value *> results_;
+    std::vector<bool> resolved_;
+    // leading segments of each pointer matching the current path.
+    std::vector<size_t> matched_;
+    size_t unresolved_;
+    std::vector<Frame> frames_;
+    Arena *arena_;
+    // the value being captured and the pointers waiting for it.
+    detail::TreeBuilder builder_;
+    bool capture_;
+    size_t captureDepth_;
+    size_t captureLength_;
+    std::vector<size_t> waiting_;
+    std::string scratch_;
+
+    // Move the pointers into child \p key or element \p index of the
+    // innermost open container.
+    template <typename Match> void step(Match &&match) {
+        size_t depth = frames_.size();
+        for (size_t i = 0; i < pointers_.size(); ++i) {
+            if (resolved_[i])
+                continue;
+            if (matched_[i] >= depth) // matched a previous sibling.
+                matched_[i] = depth - 1;
+            if (matched_[i] == depth - 1 && depth <= pointers_[i].size() &&
+                match(pointers_[i], depth - 1))
+                matched_[i] = depth;
+        }
+    }
+
+    bool onRawKey(std::string_view raw, bool escaped) {
+        if (capture_)
+            return builder_.onRawString(raw, escaped, true);
+        if (escaped) {
+            scratch_.resize(raw.size());
+            scratch_.resize(
+                detail::unescape(raw.data(), raw.size(), &scratch_[0]));
+            raw = scratch_;
+        }
+        step([raw](const Pointer &p, size_t i) { return p.matchKey(i, raw); });
+        return true;
+    }
+
+    // Before each value, capture it if a pointer ends here.
+    void begin() {
+        if (capture_)
+            return;
+        size_t depth = frames_.size();
+        if (depth > 0 && frames_.back().array) {
+            size_t index = frames_.back().index++;
+            step([index](const Pointer &p, size_t i) {
+                return p.matchIndex(i, index);
+            });
+        }
+
+        bool hit = false;
+        for (size_t i = 0; i < pointers_.size(); ++i)
+            hit |= !resolved_[i] && matched_[i] == depth &&
+                   pointers_[i].size() == depth;
+        if (!hit)
+            return;
+
+        // pointers further down are read from the captured value.
+        waiting_.clear();
+        for (size_t i = 0; i < pointers_.size(); ++i)
+            if (!resolved_[i] && matched_[i] == depth)
+                waiting_.push_back(i);
+        capture_ = true;
+        captureDepth_ = 0;
+        captureLength_ = depth;
+        builder_.clear();
+    }
+
+    template <typename Event> bool scalar(Event &&event) {
+        begin();
+        if (!capture_)
+            return true;
+        event();
+        return captureDepth_ > 0 || close();
+    }
+
+    bool open(bool array) {
+        begin();
+        if (capture_) {
+            ++captureDepth_;
+            return true;
+        }
+        frames_.push_back(Frame{array, 0});
+        return true;
+    }
+
+    // End of a captured value or of a container inside it.
+    bool close() {
+        if (captureDepth_ > 0 && --captureDepth_ > 0)
+            return true;
+        capture_ = false;
+        const Value *value = arena_->create<Value>(builder_.take());
+        for (size_t i : waiting_)
+            resolve(i, pointers_[i].find(*value, captureLength_));
+        return !done();
+    }
+
+    // A container on the way closed, pointers that went into it are absent.
+    bool leave() {
+        frames_.pop_back();
+        size_t depth = frames_.size();
+        for (size_t i = 0; i < pointers_.size(); ++i)
+            if (!resolved_[i] && matched_[i] >= depth)
+                resolve(i, nullptr);
+        return !done();
+    }
+
+    void resolve(size_t i, const Value *value) {
+        results_[i] = value;
+        resolved_[i] = true;
+        --unresolved_;
+    }
+};
+
+namespace detail {
+
+// Members of the merge patch \p patch merged into \p obj .
+inline void mergeMembers(Object &obj, const Object &patch) {
+    for (const Object::member_t &member : patch) {
+        std::string_view key = member.first.getString().view();
+        const Value &value = member.second;
+        if (value.isNull()) {
+            obj.erase(key);
+            continue;
+        }
+        Value *target = obj.find(key);
+        if (value.isObject() && target && target->isObject()) {
+            mergeMembers(target->getObject(), value.getObject());
+        } else if (value.isObject()) {
+            // the nulls of a new object are dropped too.
+            Value merged{Object()};
+            mergeMembers(merged.getObject(), value.getObject());
+            obj.set(key, std::move(merged));
+        } else {
+            obj.set(key, value);
+        }
+    }
+}
+
+// Runs the operations of a JSON Patch on one document in place. Each
+// change is logged with what it replaced or removed, so undo() can put the
+// document back as it was.
+class Patcher {
+  public:
+    explicit Patcher(Value &doc) : doc_(doc) {}
+
+    bool apply(const Value &op) {
+        if (!op.isObject())
+            return false;
+        const Object &obj = op.getObject();
+        const Value &name = obj["op"];
+        const Value &value = obj["value"];
+        if (!name.isString() || !isPointer(obj["path"]))
+            return false;
+        Pointer path(obj["path"].getString().view());
+        std::string_view kind = name.getString().view();
+
+        if (kind == "add")
+            return value.type() != kUnknown && add(path, value);
+        if (kind == "remove")
+            return remove(path);
+        if (kind == "replace")
+            return value.type() != kUnknown && replace(path, value);
+        if (kind == "test") {
+            const Value *v = path.find(std::as_const(doc_));
+            return v && *v == value;
+        }
+
+        if (!isPointer(obj["from"]))
+            return false;
+        Pointer from(obj["from"].getString().view());
+        const Value *v = from.find(std::as_const(doc_));
+        if (!v)
+            return false;
+        Value copy = *v;
+        if (kind == "copy")
+            return add(path, copy);
+        // a value can not move into itself.
+        if (kind == "move")
+            return !isPrefix(from, path) && remove(from) && add(path, copy);
+        return false;
+    }
+
+    /// Revert every change, the last one first.
+    void undo() {
+        while (!changes_.empty()) {
+            revert(changes_.back());
+            changes_.pop_back();
+        }
+    }
+
+  private:
+    // A member or element at path set, added or removed. Reverted in the
+    // state right after it, where path finds the same parent.
+    struct Change {
+        enum Kind { kSet, kAdded, kRemoved } kind;
+        Pointer path;
+        size_t index; // of the element or of a removed member.
+        Value old;    // the value set over or removed.
+    };
+
+    void log(Change::Kind kind, const Pointer &path, size_t index,
+             Value old) {
+        changes_.push_back(Change{kind, path, index, std::move(old)});
+    }
+
+    void revert(Change &change) {
+        const Pointer &path = change.path;
+        if (path.size() == 0) {
+            doc_ = std::move(change.old);
+            return;
+        }
+        Value *p = parent(path);
+        std::string_view key = path[path.size() - 1];
+        if (p->isObject()) {
+            Object &obj = p->getObject();
+            if (change.kind == Change::kSet)
+                obj.set(key, std::move(change.old));
+            else if (change.kind == Change::kAdded)
+                obj.erase(key);
+            else
+                obj.insert(change.index, Value(String(key.data(), key.size())),
+                           std::move(change.old));
+            return;
+        }
+        Array &array = p->getArray();
+        if (change.kind == Change::kSet)
+            array.set(change.index, std::move(change.old));
+        else if (change.kind == Change::kAdded)
+            array.erase(change.index);
+        else
+            array.insert(change.index, std::move(change.old));
+    }
+
+    static bool isPointer(const Value &v) {
+        return v.isString() && Pointer::valid(v.getString().view());
+    }
+    static bool isPrefix(const Pointer &prefix, const Pointer &pointer) {
+        if (prefix.size() >= pointer.size())
+            return false;
+        for (size_t i = 0; i < prefix.size(); ++i)
+            if (prefix[i] != pointer[i])
+                return false;
+        return true;
+    }
+
+    // The value holding the last segment of \p pointer , null if missing.
+    // Heap containers on the way are made private to the document.
+    Value *parent(const Pointer &pointer) {
+        Value *v = &doc_;
+        for (size_t i = 0; v && i + 1 < pointer.size(); ++i) {
+            if (v->isObject()) {
+                v = v->getObject().find(pointer[i]);
+            } else if (v->isArray()) {
+                Array &array = v->getArray();
+                size_t index = pointer.index(i);
+                v = index < array.size() ? &array[index] : nullptr;
             } else {
-                peek();
+                v = nullptr;
+            }
+        }
+        return v;
+    }
+
+    bool add(const Pointer &path, const Value &value) {
+        if (path.size() == 0) {
+            log(Change::kSet, path, 0, std::move(doc_));
+            doc_ = value;
+            return true;
+        }
+        Value *p = parent(path);
+        size_t last = path.size() - 1;
+        if (p && p->isObject()) {
+            Object &obj = p->getObject();
+            if (Value *v = obj.find(path[last]))
+                log(Change::kSet, path, 0, std::move(*v));
+            else
+                log(Change::kAdded, path, 0, Value());
+            obj.set(path[last], value);
+            return true;
+        }
+        if (!p || !p->isArray())
+            return false;
+        Array &array = p->getArray();
+        size_t index = path[last] == "-" ? array.size() : path.index(last);
+        if (index > array.size())
+            return false;
+        array.insert(index, value);
+        log(Change::kAdded, path, index, Value());
+        return true;
+    }
+
+    // Every member with the key goes, the first one is put back last.
+    bool remove(const Pointer &path) {
+        Value *p = path.size() > 0 ? parent(path) : nullptr;
+        size_t last = path.size() - 1;
+        if (p && p->isObject()) {
+            Object &obj = p->getObject();
+            size_t n = 0;
+            for (size_t i = obj.size(); i-- > 0;) {
+                if (obj[i].first.getString().view() != path[last])
+                    continue;
+                log(Change::kRemoved, path, i,
+                    std::move(obj.memberList_[i].second));
+                obj.erase(i);
+                ++n;
             }
-        } while (next());
+            return n > 0;
+        }
+        if (!p || !p->isArray() || path.index(last) >= p->getArray().size())
+            return false;
+        Array &array = p->getArray();
+        size_t index = path.index(last);
+        log(Change::kRemoved, path, index, std::move(array[index]));
+        array.erase(index);
+        return true;
+    }
+
+    bool replace(const Pointer &path, const Value &value) {
+        if (path.size() == 0) {
+            log(Change::kSet, path, 0, std::move(doc_));
+            doc_ = value;
+            return true;
+        }
+        Value *p = parent(path);
+        size_t last = path.size() - 1;
+        Value *v = p && p->isObject() ? p->getObject().find(path[last])
+                                      : nullptr;
+        if (v) {
+            log(Change::kSet, path, 0, std::move(*v));
+            p->getObject().set(path[last], value);
+            return true;
+        }
+        if (!p || !p->isArray() || path.index(last) >= p->getArray().size())
+            return false;
+        size_t index = path.index(last);
+        log(Change::kSet, path, index, std::move(p->getArray()[index]));
+        p->getArray().set(index, value);
+        return true;
+    }
 
-        size_t len = token() - begin;
+    Value &doc_;
+    std::vector<Change> changes_;
+};
 
-        // check(next(), '\"', "Parsing string end");
-        assert(next() == '\"');
+} // namespace detail
 
-        Value value(ValueType::kString, String(begin, len));
-        return value;
+/// Apply the RFC 7396 merge patch \p patch to \p target . An object patch
+/// sets its members recursively and removes those that are null, any other
+/// patch replaces the target.
+inline void mergePatch(Value &target, const Value &patch) {
+    if (!patch.isObject()) {
+        target = patch;
+        return;
+    }
+    if (!target.isObject())
+        target = Value(Object());
+    detail::mergeMembers(target.getObject(), patch.getObject());
+}
+
+/// Apply the RFC 6902 JSON Patch \p patch , an array of operations, to
+/// \p target in place. Returns false if an operation is malformed, a path
+/// is missing or a test fails, the operations applied before it are then
+/// undone and \p target is left as it was.
+inline bool applyPatch(Value &target, const Value &patch) {
+    if (!patch.isArray())
+        return false;
+    detail::Patcher patcher(target);
+    for (const Value &op : patch.getArray()) {
+        if (!patcher.apply(op)) {
+            patcher.undo();
+            return false;
+        }
     }
+    return true;
+}
+
+/// Edits of a parsed \c LazyDocument written out by copying the input
+/// around them, so only the new values are formatted. Pointers address the
+/// input as parsed and edits do not move each other, an insert before
+/// element 2 and a removal of element 2 both mean the third element of the
+/// input. A container whose members changed is written with a bare ','
+/// between its members, whitespace elsewhere is kept.
+///
+///   Splice splice(doc);
+///   splice.replace(Pointer("/user/name"), Value(String("x")));
+///   splice.remove(Pointer("/debug"));
+///   std::string out = splice.str();
+class Splice {
+  public:
+    /// \p doc has to outlive the splice.
+    explicit Splice(const LazyDocument &doc) : doc_(doc) {}
 
-    // '[' ws | elements ']'
-    Value parseArray() {
-        assert(next() == '[');
+    /// Replace the value at \p pointer , false if there is none, or if it
+    /// was removed or is inside a value replaced before. Edits inside the
+    /// value are dropped.
+    bool replace(const Pointer &pointer, const Value &value) {
+        LazyValue target = locate(pointer, pointer.size());
+        if (target.index_ == LazyValue::kNone || edited(target.index_))
+            return false;
+        dropEdits(target.index_, skip(target.index_));
+        Edit edit{target.index_, skip(target.index_), false, format(value),
+                  {}, {}};
+        edits_.insert(lowerBound(target.index_), std::move(edit));
+        return true;
+    }
 
-        Array array;
-        // parse ws or elements
-        parseWhitespace();
-        if (peek() != ']')
-            parseElements(array);
+    /// Set a member, or insert an element before the one at the index or
+    /// at the end for "-", like the JSON Patch add.
+    bool add(const Pointer &pointer, const Value &value) {
+        if (pointer.size() == 0)
+            return replace(pointer, value);
+        size_t last = pointer.size() - 1;
+        LazyValue parent = locate(pointer, last);
+        if (parent.index_ == LazyValue::kNone || edited(parent.index_))
+            return false;
 
-        assert(next() == ']');
+        uint32_t before = doc_.match_[parent.index_];
+        std::string text = format(value);
+        if (parent.isObject()) {
+            if (parent[pointer[last]].index_ != LazyValue::kNone)
+                return replace(pointer, value);
+            std::string_view key = pointer[last];
+            text = format(Value(String(key.data(), key.size()))) + ':' + text;
+        } else if (!parent.isArray()) {
+            return false;
+        } else if (pointer[last] != "-") {
+            size_t index = pointer.index(last);
+            LazyValue element = index != SIZE_MAX ? parent[index] : LazyValue();
+            if (element.index_ != LazyValue::kNone)
+                before = element.index_;
+            else if (index != parent.size())
+                return false;
+        }
+        members(parent.index_).inserted.emplace_back(before, std::move(text));
+        return true;
+    }
 
-        Value value(ValueType::kArray, array);
-        return value;
+    /// Remove the member or element at \p pointer , false if there is none.
+    bool remove(const Pointer &pointer) {
+        if (pointer.size() == 0)
+            return false;
+        size_t last = pointer.size() - 1;
+        LazyValue parent = locate(pointer, last);
+        if (parent.index_ == LazyValue::kNone || edited(parent.index_))
+            return false;
+
+        LazyValue child;
+        if (parent.isObject())
+            child = parent[pointer[last]];
+        else if (parent.isArray() && pointer.index(last) != SIZE_MAX)
+            child = parent[pointer.index(last)];
+        if (child.index_ == LazyValue::kNone || edited(child.index_))
+            return false;
+        // a member starts at its key, three entries before the value.
+        uint32_t first = child.index_ - (parent.isObject() ? 3 : 0);
+        dropEdits(first, skip(child.index_));
+        members(parent.index_).removed.emplace_back(first, skip(child.index_));
+        return true;
     }
 
-    // '{ ws | members '}'
-    Value praseObject() {
-        assert(next() == '{');
+    size_t size() const { return edits_.size(); }
+    void clear() { edits_.clear(); }
 
-        Object obj;
+    /// The input with every edit applied.
+    std::string str() const {
+        std::string out;
+        emit(out, 0, doc_.data_.size(), 0, UINT32_MAX);
+        return out;
+    }
+    /// Stream the same output to \p sink in chunks of about \p chunkSize
+    /// bytes, nothing else is built. Pieces at least that long, spans of
+    /// the input or added values, are written as they are.
+    void write(Sink &sink, size_t chunkSize = 64 * 1024) const {
+        Chunks out{sink, chunkSize, {}};
+        emit(out, 0, doc_.data_.size(), 0, UINT32_MAX);
+        out.flush();
+    }
 
-        // parse ws or members
-        parseWhitespace();
-        if (peek() != '}')
-            parseMembers(obj);
+  private:
+    // A value replaced by text, or a container whose members changed. Both
+    // span the index entries [entry, last).
+    struct Edit {
+        uint32_t entry;
+        uint32_t last;
+        bool members;
+        std::string text;
+        // entries of the removed members.
+        std::vector<std::pair<uint32_t, uint32_t>> removed;
+        // members added before an entry, the closing bracket for the end.
+        std::vector<std::pair<uint32_t, std::string>> inserted;
+    };
 
-        assert(next() == '}');
+    // Output of write(), short pieces are gathered before they go to the
+    // sink.
+    struct Chunks {
+        Sink &sink;
+        size_t chunkSize;
+        std::string buffer;
 
-        Value value(ValueType::kObject, obj);
-        return value;
+        void append(const char *data, size_t n) {
+            if (buffer.size() + n > chunkSize) {
+                flush();
+                if (n >= chunkSize) {
+                    sink.write(data, n);
+                    return;
+                }
+            }
+            buffer.append(data, n);
+        }
+        void flush() {
+            if (!buffer.empty())
+                sink.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    };
+
+    uint32_t skip(uint32_t entry) const {
+        return LazyValue(&doc_, entry).skip(entry);
+    }
+    const char *token(uint32_t entry) const {
+        return doc_.data_.data() + doc_.index_[entry];
+    }
+    // Just past the last character of the value at \p entry .
+    size_t valueEnd(uint32_t entry) const {
+        switch (*token(entry)) {
+        case '[':
+        case '{':
+            return doc_.index_[doc_.match_[entry]] + 1;
+        case '\"':
+            return doc_.index_[entry + 1] + 1;
+        default: {
+            size_t end = doc_.index_[entry + 1];
+            while (end > doc_.index_[entry] &&
+                   std::strchr(" \t\n\r", doc_.data_[end - 1]))
+                --end;
+            return end;
+        }
+        }
+    }
+
+    // The first \p n segments of \p pointer from the root.
+    LazyValue locate(const Pointer &pointer, size_t n) const {
+        LazyValue v = pointer.ok() ? doc_.root() : LazyValue();
+        for (size_t i = 0; i < n; ++i) {
+            if (v.isObject())
+                v = v[pointer[i]];
+            else if (v.isArray() && pointer.index(i) != SIZE_MAX)
+                v = v[pointer.index(i)];
+            else
+                return LazyValue();
+        }
+        return v;
+    }
+
+    static std::string format(const Value &value) {
+        FormatOptions compact;
+        compact.compact = true;
+        Formatter formatter(compact);
+        formatter.format(value);
+        return std::string(formatter.data(), formatter.size());
+    }
+
+    std::vector<Edit>::iterator lowerBound(uint32_t entry) {
+        return std::lower_bound(
+            edits_.begin(), edits_.end(), entry,
+            [](const Edit &edit, uint32_t e) { return edit.entry < e; });
+    }
+    std::vector<Edit>::const_iterator
+    lowerBound(std::vector<Edit>::const_iterator first, uint32_t entry) const {
+        return std::lower_bound(
+            first, edits_.end(), entry,
+            [](const Edit &edit, uint32_t e) { return edit.entry < e; });
+    }
+
+    // Inside a replaced value or a removed member.
+    bool edited(uint32_t entry) const {
+        for (const Edit &edit : edits_) {
+            if (!edit.members && edit.entry <= entry && entry < edit.last)
+                return true;
+            for (const std::pair<uint32_t, uint32_t> &range : edit.removed)
+                if (range.first <= entry && entry < range.second)
+                    return true;
+        }
+        return false;
+    }
+
+    // Edits of the entries [first, last) are overwritten.
+    void dropEdits(uint32_t first, uint32_t last) {
+        edits_.erase(lowerBound(first), lowerBound(last));
+    }
+
+    Edit &members(uint32_t entry) {
+        std::vector<Edit>::iterator it = lowerBound(entry);
+        if (it == edits_.end() || it->entry != entry)
+            it = edits_.insert(it, Edit{entry, skip(entry), true, {}, {}, {}});
+        return *it;
+    }
+
+    // Input [from, to) holding the entries [first, last) to \p out , a
+    // std::string or Chunks, edits applied.
+    template <typename Out>
+    void emit(Out &out, size_t from, size_t to, uint32_t first,
+              uint32_t last) const {
+        const char *data = doc_.data_.data();
+        auto it = lowerBound(edits_.begin(), first);
+        while (it != edits_.end() && it->entry < last) {
+            out.append(data + from, doc_.index_[it->entry] - from);
+            if (it->members)
+                emitMembers(out, *it);
+            else
+                out.append(it->text.data(), it->text.size());
+            from = valueEnd(it->entry);
+            it = lowerBound(it, it->last); // edits inside were written.
+        }
+        out.append(data + from, to - from);
+    }
+
+    template <typename Out>
+    void emitMembers(Out &out, const Edit &edit) const {
+        bool object = *token(edit.entry) == '{';
+        uint32_t close = doc_.match_[edit.entry];
+        bool any = false;
+        auto separate = [&] {
+            if (any)
+                out.append(",", 1);
+            any = true;
+        };
+
+        out.append(object ? "{" : "[", 1);
+        for (uint32_t i = edit.entry + 1;;) {
+            for (const std::pair<uint32_t, std::string> &member : edit.inserted)
+                if (member.first == i) {
+                    separate();
+                    out.append(member.second.data(), member.second.size());
+                }
+            if (i >= close)
+                break;
+            uint32_t value = object ? i + 3 : i, next = skip(value);
+            bool removed = false;
+            for (const std::pair<uint32_t, uint32_t> &range : edit.removed)
+                removed |= range.first == i;
+            if (!removed) {
+                separate();
+                emit(out, doc_.index_[i], valueEnd(value), i, next);
+            }
+            i = next + (*token(next) == ',');
+        }
+        out.append(object ? "}" : "]", 1);
     }
+
+    const LazyDocument &doc_;
+    std::vector<Edit> edits_;
 };
 
-/// JSON
-class Document {
+/// Members of a struct bound to JSON objects, specialize it with a tuple
+/// of \c field() , one per member:
+///
+///   template <> struct Binding<Point> {
+///       static constexpr auto fields =
+///           std::make_tuple(field("x", &Point::x), field("y", &Point::y));
+///   };
+template <typename T> struct Binding;
+
+template <typename T, typename M> struct Field {
+    std::string_view name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> field(std::string_view name, M T::*member) {
+    return Field<T, M>{name, member};
+}
+
+namespace detail {
+
+template <typename T, typename = void> struct IsBound : std::false_type {};
+template <typename T>
+struct IsBound<T, std::void_t<decltype(Binding<T>::fields)>>
+    : std::true_type {};
+
+template <typename T> struct IsVector : std::false_type {};
+template <typename T, typename A>
+struct IsVector<std::vector<T, A>> : std::true_type {};
+
+template <typename T> struct IsOptional : std::false_type {};
+template <typename T> struct IsOptional<std::optional<T>> : std::true_type {};
+
+constexpr uint32_t bindingHash(std::string_view key, uint32_t seed) {
+    uint32_t h = seed ^ static_cast<uint32_t>(key.size());
+    for (char ch : key)
+        h = (h ^ static_cast<uint8_t>(ch)) * 0x01000193;
+    return h ^ (h >> 16);
+}
+
+/// Perfect hash of the keys of a binding, the seed is searched at compile
+/// time so that every key has a slot of its own.
+template <size_t N> struct KeyTable {
+    static constexpr size_t kSlots = N <= 4 ? 16 : N <= 16 ? 64 : 256;
+    static_assert(N > 0 && N <= 64, "A binding has 1 to 64 fields");
+
+    std::string_view keys[N] = {};
+    uint8_t slots[kSlots] = {}; // field + 1, 0 when empty.
+    uint32_t seed = 0;
+
+    /// Field of \p key , -1 if none.
+    constexpr int find(std::string_view key) const {
+        uint8_t slot = slots[bindingHash(key, seed) & (kSlots - 1)];
+        return slot != 0 && keys[slot - 1] == key ? slot - 1 : -1;
+    }
+};
+
+template <size_t N>
+constexpr KeyTable<N> makeKeyTable(const std::string_view (&keys)[N]) {
+    KeyTable<N> table;
+    for (size_t i = 0; i < N; ++i)
+        table.keys[i] = keys[i];
+    for (;; ++table.seed) {
+        bool unique = true;
+        for (size_t i = 0; i < KeyTable<N>::kSlots; ++i)
+            table.slots[i] = 0;
+        for (size_t i = 0; i < N && unique; ++i) {
+            uint8_t &slot = table.slots[bindingHash(keys[i], table.seed) &
+                                        (KeyTable<N>::kSlots - 1)];
+            unique = slot == 0;
+            slot = static_cast<uint8_t>(i + 1);
+        }
+        if (unique)
+            return table;
+        // a repeated key never gets a slot of its own.
+        assert(table.seed < 100000 && "Repeated key in a binding");
+    }
+}
+
+template <typename T, size_t... I>
+constexpr auto makeBindingTable(std::index_sequence<I...>) {
+    const std::string_view keys[] = {std::get<I>(Binding<T>::fields).name...};
+    return makeKeyTable(keys);
+}
+
+template <typename T> struct BindingTable {
+    static constexpr size_t kFields =
+        std::tuple_size_v<std::decay_t<decltype(Binding<T>::fields)>>;
+    static constexpr auto value =
+        makeBindingTable<T>(std::make_index_sequence<kFields>());
+};
+
+} // namespace detail
+
+/// Parser that fills C++ values straight from the input, no \c Value is
+/// built. It reads bool, arithmetic types, std::string, std::vector and
+/// std::optional of those, and structs with a \c Binding . Keys of a
+/// struct are dispatched by a perfect hash built at compile time, unknown
+/// keys are skipped and members whose key is missing are left alone.
+/// Integer members only take integers in their range.
+class Binder : private detail::TokenReader {
   public:
-    Document() : Document("", 0) {}
-    Document(const char *data)
-        : Document(data, std::char_traits<char>::length(data)) {}
-    Document(const char *data, size_t n) : data_(data, n), parser_(data, n) {}
-    Document(const FileStream &input) : Document(input.data(), input.size()) {}
+    Binder(const char *data, size_t n)
+        : TokenReader(data, n, ParseOptions().maxDepth) {}
+
+    /// Rebind to new input, the index keeps its capacity.
+    void reset(const char *data, size_t n) {
+        view_ = std::string_view(data, n);
+        cursor_ = nullptr;
+    }
 
-    void parse() { rootValue_ = parser_.parse(); }
+    /// Fill \p out , returns false if the document is malformed or does not
+    /// fit its type, which \c result() reports as \c kTypeMismatch .
+    /// Members read before the failure keep their new values.
+    template <typename T> bool parse(T &out) {
+        error_ = kNoError;
+        if (view_.size() == 0)
+            return fail(kUnexpectedEnd, 0);
+        if (!start())
+            return false;
+        if (!read(out))
+            return error_ == kNoError ? fail(kTypeMismatch) : false;
+        if (!atEnd())
+            return fail(kTrailingCharacters, position());
+        return true;
+    }
 
-    void format() { formatter_.format(rootValue_); }
+    using TokenReader::result;
 
   private:
-    std::string_view data_;
-    Value rootValue_;
-    Parser parser_;
-    Formatter formatter_;
+    std::string scratch_; // escaped key.
+
+    template <typename T> bool read(T &out) {
+        if constexpr (std::is_same_v<T, bool>) {
+            char ch = peek();
+            if (ch == 't' ? !parseLiteral("true", 4)
+                          : ch != 'f' || !parseLiteral("false", 5))
+                return false;
+            out = ch == 't';
+            return true;
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            char ch = peek();
+            Number number(0);
+            if (ch != '-' && (ch < '0' || ch > '9'))
+                return false;
+            return parseNumber(number) && convert(number, out);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            if (peek() != '\"')
+                return false;
+            bool escaped = false;
+            std::string_view raw;
+            if (!scanString(raw, escaped))
+                return false;
+            if (!escaped) {
+                out.assign(raw.data(), raw.size());
+            } else {
+                out.resize(raw.size());
+                out.resize(detail::unescape(raw.data(), raw.size(), &out[0]));
+            }
+            return true;
+        } else if constexpr (detail::IsOptional<T>::value) {
+            if (peek() == 'n') {
+                if (!parseLiteral("null", 4))
+                    return false;
+                out.reset();
+                return true;
+            }
+            if (!out)
+                out.emplace();
+            return read(*out);
+        } else if constexpr (detail::IsVector<T>::value) {
+            if (peek() != '[')
+                return false;
+            next();
+            out.clear();
+            if (peek() != ']') {
+                for (;;) {
+                    out.emplace_back();
+                    if (!read(out.back()))
+                        return false;
+                    if (peek() != ',')
+                        break;
+                    next();
+                }
+            }
+            return expect(']', kExpectedCommaOrEnd);
+        } else {
+            static_assert(detail::IsBound<T>::value, "No Binding for a type");
+            return readObject(out);
+        }
+    }
+
+    template <typename T> static bool convert(Number number, T &out) {
+        if constexpr (std::is_floating_point_v<T>) {
+            out = static_cast<T>(number.getNumber());
+            return true;
+        } else if (number.isInt64()) {
+            int64_t v = number.getInt64();
+            if (v < 0 ? !std::is_signed_v<T> ||
+                            v < int64_t(std::numeric_limits<T>::min())
+                      : uint64_t(v) > uint64_t(std::numeric_limits<T>::max()))
+                return false;
+            out = static_cast<T>(v);
+            return true;
+        } else if (number.isUint64()) {
+            if (number.getUint64() > uint64_t(std::numeric_limits<T>::max()))
+                return false;
+            out = static_cast<T>(number.getUint64());
+            return true;
+        }
+        // -0 is parsed as a double, it still fits any integer.
+        if (number.getNumber() == 0 && std::signbit(number.getNumber())) {
+            out = 0;
+            return true;
+        }
+        return false;
+    }
+
+    template <typename T> bool readObject(T &out) {
+        if (peek() != '{')
+            return false;
+        next();
+        if (peek() != '}') {
+            for (;;) {
+                if (peek() != '\"')
+                    return fail(kExpectedKey);
+                bool escaped = false;
+                std::string_view key;
+                if (!scanString(key, escaped) ||
+                    !expect(':', kExpectedColon))
+                    return false;
+                if (escaped) {
+                    scratch_.resize(key.size());
+                    scratch_.resize(detail::unescape(key.data(), key.size(),
+                                                     &scratch_[0]));
+                    key = scratch_;
+                }
+
+                using Table = detail::BindingTable<T>;
+                int field = Table::value.find(key);
+                if (field < 0) {
+                    if (!skipValue())
+                        return false;
+                } else if (!readField(
+                             out, field,
+                             std::make_index_sequence<Table::kFields>()))
+                    return false;
+                if (peek() != ',')
+                    break;
+                next();
+            }
+        }
+        return expect('}', kExpectedCommaOrEnd);
+    }
+
+    template <typename T, size_t... I>
+    bool readField(T &out, int field, std::index_sequence<I...>) {
+        bool ok = false;
+        (void)((I == size_t(field) &&
+                (ok = read(out.*std::get<I>(Binding<T>::fields).member),
+                 true)) ||
+               ...);
+        return ok;
+    }
+
+    // Drops every event of a skipped value, strings are not decoded.
+    struct Skipper : BaseHandler<Skipper> {
+        bool onRawString(std::string_view, bool, bool) { return true; }
+    };
+
+    // A value of any shape, checked like the parser does but not read.
+    bool skipValue() {
+        Skipper skipper;
+        return parseValue(skipper);
+    }
 };
 
+
 } // namespace nextjson
\ No newline at end of file
@@ -1,24 +1,1664 @@
-#include "nextjson.h"
+#include "json.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
 using namespace nextjson;
 
-int size = 0;
+// counted from every thread.
+std::atomic<int> size(0);
 
 void *operator new(size_t n) {
     size += n;
     return std::malloc(n);
 }
 
-int main() {
-    nextjson::FileStream input("./json/array.json");
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+void test_value() {
+    static_assert(sizeof(Value) == 16);
+
+    Document doc("[false,true,123,null, \"string\", {\"key\":3.14156}]");
+    doc.parse();
+
+    const Array &arr = doc.root().getArray();
+    assert(arr.size() == 6);
+    assert(arr[0].type() == kFalse && !arr[0].getBool());
+    assert(arr[1].getBool());
+    assert(arr[2].getNumber().getNumber() == 123);
+    assert(arr[3].isNull());
+    assert(arr[4].getString().getString() == "string");
+
+    std::string key = "key";
+    assert(arr[5].getObject()[key].getNumber().getNumber() == 3.14156);
+}
+
+void test_scalar_no_alloc() {
+    Document doc("[1,2,3,4,5,6,7,8,true,false,null]");
+    doc.parse();
+    const Array &arr = doc.root().getArray();
+
+    // copying scalar elements must not allocate.
+    int before = size;
+    for (size_t i = 0; i < arr.size(); ++i)
+        Value v = arr[i];
+    assert(size == before);
+}
+
+void test_arena() {
+    Document doc("{\"a\":[1,2,\"x\"],\"b\":{}}");
+    doc.parse();
+    assert(!doc.root().isOwned());
+    size_t capacity = doc.arena().capacity();
+
+    // copies leave the arena.
+    Value copy = doc.root();
+    assert(copy.isOwned());
+    assert(copy.getObject()[0].second.getArray()[2].isOwned());
+
+    // reused document keeps its blocks.
+    doc.reset("[\"y\",[true],{\"k\":null}]");
+    doc.parse();
+    assert(doc.arena().capacity() == capacity);
+    assert(doc.root().getArray()[2].getObject()["k"].isNull());
+
+    Array arr;
+    arr.add(copy);
+    arr.add(Value(String("z")));
+    assert(arr[1].getString().view() == "z");
+
+    // an aligned allocation after a large unaligned copy.
+    Arena arena;
+    arena.copy(std::string(5000, 'x').data(), 5000);
+    assert(*arena.create<double>(1.0) == 1.0);
+}
+
+void test_zero_copy() {
+    const char *json = "{\"plain\":\"abc\","
+                       "\"esc\\n\":\"a\\\"b\\u00e9\\ud83d\\ude00\"}";
+    ParseOptions options;
+    options.zeroCopy = true;
+    Document doc(json, options);
+    doc.parse();
+
+    const Object &obj = doc.root().getObject();
+    assert(obj[0].first.getString().data() == json + 2);
+    assert(obj[0].second.getString().data() == json + 10);
+    assert(obj[1].first.getString().view() == "esc\n");
+    assert(obj[1].second.getString().view() == "a\"b\xc3\xa9\xf0\x9f\x98\x80");
+
+    // escaped strings are written back as they were read.
+    doc.format();
+    std::string out(doc.formatter().data(), doc.formatter().size());
+    assert(out.find("\"a\\\"b\\u00e9\\ud83d\\ude00\"") != std::string::npos);
+
+    Formatter formatter;
+    formatter.format(Value(String("q\"\n")));
+    assert(std::string(formatter.data(), formatter.size()) == "\"q\\\"\\n\"");
+
+    Document copy(json);
+    copy.parse();
+    assert(copy.root().getObject()["plain"].getString().data() != json + 10);
+    assert(copy.root().getObject()[1].second.getString().view() ==
+           "a\"b\xc3\xa9\xf0\x9f\x98\x80");
+}
+
+// byte by byte structural index.
+std::vector<uint32_t> scalar_index(const std::string &json) {
+    std::vector<uint32_t> index;
+    bool inString = false, escaped = false, prevScalar = false;
+    for (size_t i = 0; i < json.size(); ++i) {
+        char ch = json[i];
+        bool isEscaped = escaped;
+        escaped = ch == '\\' && !isEscaped;
+        if (ch == '\"' && !isEscaped) {
+            inString = !inString;
+            index.push_back(i);
+            prevScalar = false;
+            continue;
+        }
+        if (inString)
+            continue;
+
+        bool op = ch != '\0' && std::strchr("{}[]:,", ch);
+        bool ws = ch != '\0' && std::strchr(" \t\n\r", ch);
+        if (op || (!ws && !prevScalar))
+            index.push_back(i);
+        prevScalar = !op && !ws;
+    }
+    index.push_back(json.size());
+    return index;
+}
+
+void test_structural_index() {
+    const char alphabet[] = "{}[]:, \t\n\"\"\\\\ab1";
+    srand(1);
+    StructuralIndex index;
+    for (int round = 0; round < 2000; ++round) {
+        std::string json(rand() % 300, ' ');
+        for (char &ch : json)
+            ch = alphabet[rand() % (sizeof(alphabet) - 1)];
+        std::vector<uint32_t> expected = scalar_index(json);
+
+        for (int level = kSimdScalar; level <= kSimdNeon; ++level) {
+            if (!simdSupported(SimdLevel(level)))
+                continue;
+            index.build(json.data(), json.size(), SimdLevel(level));
+            assert(index.size() + 1 == expected.size());
+            assert(std::equal(expected.begin(), expected.end(), index.data()));
+
+            // flagged exactly when a block the range touches has one.
+            for (size_t i = 0; i + 1 < json.size(); i += 13) {
+                size_t end = std::min(json.size(), i + 1 + rand() % 100);
+                size_t first = i / 64 * 64;
+                size_t last = std::min(json.size(), (end + 63) / 64 * 64);
+                bool slash = json.find('\\', first) < last;
+                assert(index.mayHaveBackslash(i, end) == slash);
+            }
+        }
+    }
+
+    assert(!index.build("[\"abc]", 6));
+    assert(index.build("[\"a\\\"\"]", 7) && index.size() == 4);
+}
+
+void test_deep_nesting() {
+    // one frame per level, none per element.
+    std::string wide = "[";
+    for (int i = 0; i < 100000; ++i)
+        wide += i ? ",[1]" : "[1]";
+    wide += "]";
+    Document doc(wide.data(), wide.size());
+    doc.parse();
+    assert(doc.root().getArray().size() == 100000);
+
+    ParseOptions options;
+    options.maxDepth = 200000;
+    std::string deep = std::string(100000, '[') + std::string(100000, ']');
+    Document nested(deep.data(), deep.size(), options);
+    nested.parse();
+    const Value *v = &nested.root();
+    size_t depth = 0;
+    for (; v->getArray().size() == 1; v = &v->getArray()[0])
+        ++depth;
+    assert(depth == 99999);
+}
+
+Number parse_number(const char *json) {
+    Document doc(json);
+    doc.parse();
+    return doc.root().getNumber();
+}
+
+void test_number() {
+    assert(parse_number("0").getInt64() == 0);
+    // -0 keeps its sign as a double, and formats back as it was read.
+    Number zero = parse_number("-0");
+    assert(zero.isDouble() && zero.getNumber() == 0);
+    assert(std::signbit(zero.getNumber()));
+    Document signs("[-0,0,-0.0,-0e3]");
+    signs.parse();
+    FormatOptions compact;
+    compact.compact = true;
+    signs.format(compact);
+    assert(std::string(signs.formatter().data(), signs.formatter().size()) ==
+           "[-0,0,-0,-0]");
+    assert(parse_number("9007199254740993").getInt64() == 9007199254740993);
+    assert(parse_number("-9223372036854775808").getInt64() == INT64_MIN);
+    assert(parse_number("18446744073709551615").getUint64() == UINT64_MAX);
+    assert(parse_number("18446744073709551616").getNumber() ==
+           18446744073709551616.0);
+    assert(parse_number("-3.14e-10").getNumber() == -3.14e-10);
+    assert(parse_number("2.5e-330").getNumber() == 0.0);
+    assert(parse_number("0.000001234").getNumber() == 0.000001234);
+    assert(parse_number("123456789012345678901234567890e-10").getNumber() ==
+           123456789012345678901234567890e-10);
+
+    // same doubles as strtod.
+    srand(2);
+    char buf[64];
+    for (int i = 0; i < 20000; ++i) {
+        double d = (rand() / double(RAND_MAX) - 0.5) *
+                   std::pow(10, rand() % 40 - 20);
+        snprintf(buf, sizeof(buf), "%.*g", 1 + rand() % 17, d);
+        assert(parse_number(buf).getNumber() == std::strtod(buf, NULL));
+    }
+
+    Value id(uint64_t(12345678901234567890ULL));
+    assert(id.getNumber().getUint64() == 12345678901234567890ULL);
+    assert(Value(3).getNumber().getInt64() == 3);
+}
+
+std::string format_value(const Value &value) {
+    Formatter formatter;
+    formatter.format(value);
+    return std::string(formatter.data(), formatter.size());
+}
+
+void test_format_number() {
+    assert(format_value(Value(0)) == "0");
+    assert(format_value(Value(INT64_MIN)) == "-9223372036854775808");
+    assert(format_value(Value(UINT64_MAX)) == "18446744073709551615");
+    assert(format_value(Value(3.0)) == "3");
+    assert(format_value(Value(-0.0)) == "-0");
+    assert(format_value(Value(0.1)) == "0.1");
+    assert(format_value(Value(1e-9)) == "1e-09");
+    assert(format_value(Value(HUGE_VAL)) == "null");
+
+    // shortest text that reads back the same double.
+    srand(3);
+    for (int i = 0; i < 20000; ++i) {
+        uint64_t bits = (uint64_t(rand()) << 40) ^ (uint64_t(rand()) << 20) ^
+                        uint64_t(rand());
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        if (!std::isfinite(d))
+            continue;
+        std::string text = format_value(Value(d));
+        assert(std::strtod(text.c_str(), NULL) == d);
+        assert(text.size() <= 24);
+    }
+}
+
+void test_format_options() {
+    const char *json = "{\"a\":[1,{\"b\":null},[]],\"c\":{}}";
+
+    Document doc(json);
+    doc.parse();
+    doc.format();
+    assert(std::string(doc.formatter().data(), doc.formatter().size()) ==
+           "{\n\t\"a\":[\n\t\t1,\n\t\t{\n\t\t\t\"b\":null\n\t\t},\n\t\t[]\n\t],"
+           "\n\t\"c\":{}\n}");
+
+    FormatOptions compact;
+    compact.compact = true;
+    Formatter formatter(compact);
+    formatter.format(doc.root());
+    assert(std::string(formatter.data(), formatter.size()) == json);
+
+    FormatOptions pretty;
+    pretty.indentChar = ' ';
+    pretty.indentWidth = 2;
+    Formatter spaces(pretty);
+    spaces.format(doc.root().getObject()["a"]);
+    assert(std::string(spaces.data(), spaces.size()) ==
+           "[\n  1,\n  {\n    \"b\":null\n  },\n  []\n]");
+}
+
+void test_format_escape() {
+    const char *pieces[] = {"a", "b c", "\"", "\\", "\n", "\x01", "\x1f",
+                            "\t", "/", "\xc3\xa9", "\xe2\x82\xac", "\x7f"};
+    srand(6);
+    for (int round = 0; round < 2000; ++round) {
+        std::string str;
+        size_t n = rand() % 100;
+        while (str.size() < n) {
+            int piece = rand() % 40;
+            str += pieces[piece < 28 ? piece % 2 : piece - 28];
+        }
+
+        // from every start, so that each tail length is met.
+        const char *end = str.data() + str.size();
+        for (int level = kSimdSse2; level <= kSimdNeon; ++level) {
+            if (!simdSupported(SimdLevel(level)))
+                continue;
+            detail::FindEscapeFn find = detail::escapeFinder(SimdLevel(level));
+            for (const char *p = str.data(); p <= end; ++p)
+                assert(find(p, end) == detail::findEscapeScalar(p, end));
+        }
+
+        // what is written reads back the same.
+        Formatter formatter;
+        formatter.format(Value(String(str.data(), str.size())));
+        Document doc(formatter.data(), formatter.size());
+        assert(doc.parse().ok());
+        assert(doc.root().getString().view() == str);
+    }
+
+    Formatter formatter;
+    formatter.format(Value(String("\x01\x1f\\\b")));
+    assert(std::string(formatter.data(), formatter.size()) ==
+           "\"\\u0001\\u001f\\\\\\b\"");
+}
+
+void test_sink() {
+    std::string json = "[";
+    for (int i = 0; i < 10000; ++i)
+        json += i ? ",{\"k\":[1,2.5,\"s\"]}" : "{\"k\":[1,2.5,\"s\"]}";
+    json += "]";
+    Document doc(json.data(), json.size());
+    doc.parse();
+
+    // chunks stay bounded and add up to the whole document.
+    std::string out;
+    size_t largest = 0;
+    CallbackSink sink([&](const char *data, size_t n) {
+        out.append(data, n);
+        largest = std::max(largest, n);
+    });
+    FormatOptions compact;
+    compact.compact = true;
+    Formatter formatter(sink, compact, 4096);
+    formatter.format(doc.root());
+    assert(out == json);
+    assert(formatter.size() == 0 && largest < 4096 + 64);
+
+    FILE *file = tmpfile();
+    FileSink fileSink(file);
+    Formatter(fileSink, compact).format(doc.root());
+    assert(fileSink.ok() && size_t(ftell(file)) == json.size());
+    fclose(file);
+}
+
+void test_document_pool() {
+    std::vector<std::string> requests;
+    for (int i = 0; i < 8; ++i) {
+        std::string json = "{\"id\":" + std::to_string(i) + ",\"items\":[";
+        for (int j = 0; j < 50 * (i % 3 + 1); ++j)
+            json += (j ? ",\"item\\n" : "\"item\\n") + std::to_string(j) + "\"";
+        requests.push_back(json + "]}");
+    }
+
+    // a request loop, the second pass over the requests is warm.
+    DocumentPool &pool = DocumentPool::local();
+    assert(&pool == &DocumentPool::local());
+    const char *output = nullptr;
+    int warm = 0;
+    for (int pass = 0; pass < 3; ++pass) {
+        if (pass == 2)
+            warm = size;
+        for (const std::string &json : requests) {
+            DocumentPool::Handle doc = pool.acquire(json);
+            assert(doc->parse().ok());
+            doc->format(FormatOptions());
+            doc->format(); // replaces the first output.
+            assert(doc->root().getObject()["items"].getArray().size() > 0);
+            if (pass == 2)
+                assert(doc->formatter().data() == output);
+            output = doc->formatter().data();
+        }
+        assert(pool.idle() == 1);
+    }
+    assert(size == warm);
+
+    Document doc("[1, 2]");
+    doc.parse();
+    doc.format();
+    doc.format();
+    std::string once(doc.formatter().data(), doc.formatter().size());
+    assert(once == "[\n\t1,\n\t2\n]");
+    doc.reset("[]");
+    assert(doc.formatter().size() == 0);
+
+    Formatter formatter;
+    formatter.format(Value(kNull));
+    formatter.clear();
+    formatter.format(Value(kTrue));
+    assert(std::string(formatter.data(), formatter.size()) == "true");
+}
+
+void test_stats() {
+    const char *json = "{\"a\":[1,\"xy\",[true]],\"b\\n\":null}";
+    ParseStats before = ParseStats::thread();
+    Document doc(json);
+    doc.parse();
+    doc.format();
+    const ParseStats &stats = doc.stats();
+#if NEXTJSON_STATS
+    assert(stats.bytesScanned == std::strlen(json) && stats.maxDepth == 3);
+    assert(stats.nodes[kObject] == 1 && stats.nodes[kArray] == 2);
+    assert(stats.nodes[kNumber] == 1 && stats.nodes[kString] == 3);
+    assert(stats.nodes[kTrue] == 1 && stats.nodes[kNull] == 1);
+    assert(stats.stringBytesCopied == 6 && stats.stringBytesViewed == 0);
+    assert(stats.arenaBlocks == 1);
+    assert(ParseStats::thread().bytesScanned ==
+           before.bytesScanned + std::strlen(json));
+
+    // a warm document takes no more blocks.
+    doc.reset(json);
+    doc.parse();
+    assert(stats.arenaBlocks == 1);
+    assert(stats.bytesScanned == 2 * std::strlen(json));
+#else
+    // compiled out, nothing is counted.
+    assert(stats.bytesScanned == 0 && stats.nodes[kObject] == 0);
+    assert(doc.arena().blocks() == 0);
+    assert(ParseStats::thread().bytesScanned == before.bytesScanned);
+#endif
+}
+
+void test_move() {
+    Array inner;
+    inner.reserve(3);
+    inner.emplace(1);
+    inner.emplace(String("two"));
+    inner.add(Value(kNull));
+
+    Object obj;
+    Value &list = obj.emplace(Value(String("list")), std::move(inner));
+    const Array *listAddress = &list.getArray();
+    obj.add(Object::member_t(Value(String("n")), Value(2.5)));
+    Value root(std::move(obj));
+
+    Value doc{Array()};
+
+    // moving and formatting a built tree allocates and copies nothing.
+    int before = size;
+    Value moved = std::move(root);
+    doc.getArray().add(std::move(moved));
+    FormatOptions compact;
+    compact.compact = true;
+    Formatter formatter(compact);
+    formatter.format(doc);
+    assert(size == before);
+
+    const Object &members = doc.getArray()[0].getObject();
+    assert(&(*members.find("list")).getArray() == listAddress);
+    assert(std::string(formatter.data(), formatter.size()) ==
+           "[{\"list\":[1,\"two\",null],\"n\":2.5}]");
+
+    int count = 0;
+    for (const Object::member_t &member : members)
+        count += member.first.isString();
+    for (Value &value : doc.getArray()[0].getObject().find("list")->getArray())
+        value = Value(kTrue);
+    assert(count == 2 && members["list"].getArray()[2].getBool());
+}
+
+void test_snapshot() {
+    Document doc("{\"a\":{\"b\":[1,2]},\"c\":[3,{\"d\":4}]}");
+    doc.parse();
+    Value config = doc.root();
+    assert(config.isOwned() && !config.isShared());
+
+    // copies share the heap tree.
+    int before = size;
+    Value snapshot = config;
+    assert(size == before && config.isShared() && snapshot.isShared());
+    const Value *c = &config.getObject()[1].second;
+
+    // an edit copies the path to it, the rest stays shared.
+    snapshot.getObject().find("a")->getObject().find("b")->getArray().add(5);
+    assert(!snapshot.isShared() && !config.isShared());
+    const Object &edited = snapshot.getObject();
+    assert(edited["c"].isShared() && &edited["c"].getArray() == &c->getArray());
+    assert(config.getObject()["a"].getObject()["b"].getArray().size() == 2);
+    assert(edited["a"].getObject()["b"].getArray().size() == 3);
+    assert(format_value(config) == format_value(doc.root()));
+
+    // snapshots taken and dropped by many threads.
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+        threads.emplace_back([&config] {
+            for (int j = 0; j < 1000; ++j) {
+                Value copy = config;
+                copy.getObject().find("c")->getArray().add(j);
+                assert(copy.getObject()["c"].getArray().size() == 3);
+            }
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+    assert(config.getObject()["c"].getArray().size() == 2);
+
+    // a document copies its tree out of the arena once, then shares it.
+    Document shared("{\"a\":[1,{\"b\":\"x\"}],\"c\":{}}");
+    shared.parse();
+    Value first = shared.snapshot();
+    assert(first.isShared() && shared.root().isOwned());
+    before = size;
+    Value second = shared.snapshot();
+    Value third = shared.root();
+    assert(size == before);
+    assert(&std::as_const(second).getObject() ==
+           &std::as_const(third).getObject());
+
+    // an edit through the root leaves the snapshots alone.
+    shared.root().getObject().set("c", Value(1));
+    assert(std::as_const(first).getObject()["c"].isObject());
+    assert(shared.root().getObject()["c"].isNumber());
+    assert(std::as_const(shared.root()).getObject()["a"].isShared());
+}
+
+void test_concurrent_read() {
+    std::string json = "{";
+    for (int i = 0; i < 100; ++i)
+        json += (i ? ",\"k\\u0041" : "\"k\\u0041") + std::to_string(i) +
+                "\":\"v\\n" + std::to_string(i) + "\"";
+    json += "}";
+    Document doc(json.data(), json.size());
+    doc.parse();
+    const Value &root = doc.root();
+    Document other(json.data(), json.size());
+    other.parse();
+    std::string expected = format_value(other.root());
+
+    // the key index and decoded strings are built by the racing readers.
+    std::vector<std::thread> threads;
+    std::atomic<int> found(0);
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&] {
+            // no allocation, the counter in operator new would order the
+            // threads for a race detector.
+            const Object &obj = root.getObject();
+            char key[8], value[8];
+            for (int i = 0; i < 100; ++i) {
+                snprintf(key, sizeof(key), "kA%d", i);
+                snprintf(value, sizeof(value), "v\n%d", i);
+                const Value *v = obj.find(key);
+                found += v && v->getString().view() == value;
+            }
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+    assert(found == 400 && format_value(root) == expected);
+}
+
+void test_object_index() {
+    std::string json = "{";
+    for (int i = 0; i < 1000; ++i)
+        json += (i ? ",\"key" : "\"key") + std::to_string(i) + "\":" +
+                std::to_string(i);
+    json += ",\"key7\":-1}";
+    Document doc(json.data(), json.size());
+    doc.parse();
+
+    const Object &obj = doc.root().getObject();
+    for (int i = 0; i < 1000; ++i) {
+        std::string key = "key" + std::to_string(i);
+        assert(obj[key].getNumber().getInt64() == i);
+    }
+    assert(obj.find("key") == nullptr && obj["nokey"].type() == kUnknown);
+
+    // a repeated key keeps the first value, like the scan.
+    assert(obj[std::string_view("key7")].getNumber().getInt64() == 7);
+
+    // added members join the index.
+    Object heap;
+    for (int i = 0; i < 100; ++i) {
+        heap.add(Object::member_t(Value(String(std::to_string(i))), Value(i)));
+        assert(heap.find(std::to_string(i))->getNumber().getInt64() == i);
+    }
+    Object moved = std::move(heap);
+    assert(moved["42"].getNumber().getInt64() == 42);
+}
+
+void test_file_stream() {
+    // a page sized file leaves no slack in its last page.
+    std::string json = "[\"x\"" + std::string(4096 - 7, ' ') + ",1]";
+    const char *path = "/tmp/nextjson_file_stream.json";
+    FILE *file = fopen(path, "wb");
+    fwrite(json.data(), 1, json.size(), file);
+    fclose(file);
+
+    FileStream input(path);
+    assert(input.size() == 4096 && input.data()[4096] == '\0');
+    ParseOptions options;
+    options.zeroCopy = true;
+    Document doc(input, options);
+    doc.parse();
+    const String str = doc.root().getArray()[0].getString();
+    if (input.isMapped())
+        assert(str.data() == input.data() + 2);
+    remove(path);
+
+    FileStream missing("/tmp/nextjson_missing.json");
+    assert(missing.size() == 0 && missing.data()[0] == '\0');
+}
+
+void test_push_parser() {
+    const char *json = "{\"name\":\"a\\\"b\\u00e9\", "
+                       "\"list\":[1, -2.5e3, true, null, false, [], {}], "
+                       "\"big\":18446744073709551615}";
+    Document doc(json);
+    doc.parse();
+    FormatOptions compact;
+    compact.compact = true;
+    Formatter expected(compact);
+    expected.format(doc.root());
+    std::string text(expected.data(), expected.size());
+
+    // every split point, even inside strings, escapes and numbers.
+    size_t n = std::strlen(json);
+    for (size_t chunk = 1; chunk <= n; ++chunk) {
+        Arena arena;
+        PushParser parser(&arena);
+        for (size_t i = 0; i < n; i += chunk)
+            parser.feed(json + i, std::min(chunk, n - i));
+        assert(parser.done());
+
+        Value root = parser.finish();
+        Formatter formatter(compact);
+        formatter.format(root);
+        assert(std::string(formatter.data(), formatter.size()) == text);
+        assert(root.getObject()["name"].getString().view() == "a\"b\xc3\xa9");
+    }
+
+    // a top level scalar ends with the input.
+    Arena arena;
+    PushParser parser(&arena);
+    parser.feed("  12", 4);
+    parser.feed("34 ", 2);
+    assert(parser.finish().getNumber().getInt64() == 1234);
+    parser.reset();
+    parser.feed(" \n", 2);
+    assert(parser.finish().type() == kUnknown);
+}
+
+// sums the numbers under "n" keys, stops at "stop".
+struct SumHandler : BaseHandler<SumHandler> {
+    double sum = 0;
+    size_t arrays = 0, members = 0;
+    bool counting = false;
+
+    bool onKey(String key) {
+        counting = key.view() == "n";
+        return key.view() != "stop";
+    }
+    bool onNumber(Number number) {
+        if (counting)
+            sum += number.getNumber();
+        return true;
+    }
+    bool onEndArray(size_t n) {
+        arrays += n;
+        return true;
+    }
+    bool onEndObject(size_t n) {
+        members += n;
+        return true;
+    }
+};
+
+void test_sax() {
+    std::string json = "[{\"n\":1,\"m\":10},{\"n\":2.5,\"x\":[[],{}]},"
+                       "{\"\\u006e\":3}]";
+    Arena arena;
+    Parser parser(json.data(), json.size(), &arena);
+    SumHandler handler;
+    assert(parser.parse(handler));
+    assert(handler.sum == 6.5 && handler.arrays == 5 && handler.members == 5);
+
+    // a warm parser builds nothing.
+    int before = size;
+    SumHandler again;
+    assert(parser.parse(again) && again.sum == 6.5);
+    assert(size == before && arena.capacity() == 0);
+
+    std::string stop = "{\"n\":1,\"stop\":{\"n\":2}}";
+    parser.reset(stop.data(), stop.size());
+    SumHandler stopped;
+    assert(!parser.parse(stopped) && stopped.sum == 1);
+
+    // same events in chunks.
+    SumHandler pushed;
+    BasicPushParser<SumHandler> push(pushed);
+    for (size_t i = 0; i < json.size(); i += 3)
+        push.feed(json.data() + i, std::min<size_t>(3, json.size() - i));
+    assert(push.finish() && pushed.sum == 6.5 && pushed.members == 5);
+}
+
+void test_lazy_document() {
+    std::string json = "{\"skip\":[[1,2],{\"a\":[3]}],"
+                       "\"id\":12345678901234567890,"
+                       "\"user\":{\"name\":\"z\\u00e9\",\"ok\":true, "
+                       "\"tags\":[\"x\", null, 2.5 ]},\"k\\u0065y\":\"v\"}";
+    LazyDocument doc(json.data(), json.size());
+    doc.parse();
+
+    LazyValue root = doc.root();
+    assert(root.isObject() && root.size() == 4);
+    assert(root["id"].getNumber().getUint64() == 12345678901234567890ULL);
+    LazyValue user = root["user"];
+    assert(user["ok"].getBool() && user["missing"].type() == kUnknown);
+    assert(user["tags"].size() == 3 && user["tags"][1].isNull());
+    assert(user["tags"][2].getNumber().getNumber() == 2.5);
+    assert(user["tags"][3].type() == kUnknown);
+    assert(root["key"].getString().view() == "v");
+    assert(root["skip"][1]["a"][0].getNumber().getInt64() == 3);
+
+    // nothing was built for the values read, escaped strings are decoded.
+    assert(doc.arena().capacity() == 0);
+    assert(user["name"].getString().view() == "z\xc3\xa9");
+
+    // decoded once, later reads reuse the copy.
+    const char *name = user["name"].getString().data();
+    size_t capacity = doc.arena().capacity();
+    for (int i = 0; i < 1000; ++i)
+        assert(user["name"].getString().data() == name);
+    assert(doc.arena().capacity() == capacity);
+
+    // readers racing on the first read all get the copy published.
+    LazyDocument shared(json.data(), json.size());
+    shared.parse();
+    const char *names[4];
+    std::vector<std::thread> readers;
+    for (const char *&out : names)
+        readers.emplace_back([&shared, &out] {
+            out = shared.root()["user"]["name"].getString().data();
+        });
+    for (std::thread &reader : readers)
+        reader.join();
+    for (const char *out : names)
+        assert(out == names[0]);
+
+    Value tags = user["tags"].materialize();
+    assert(tags.getArray().size() == 3 && tags.getArray()[0].isString());
+    assert(root["skip"].materialize().getArray()[0].getArray().size() == 2);
+    assert(root["id"].materialize().getNumber().isUint64());
+
+    LazyDocument empty(" ");
+    empty.parse();
+    assert(empty.root().type() == kUnknown);
+}
+
+// counts records and sums their numbers, on one thread.
+struct CountHandler : BaseHandler<CountHandler> {
+    size_t records = 0;
+    double sum = 0;
+    size_t depth = 0;
+
+    bool onNumber(Number number) {
+        sum += number.getNumber();
+        records += depth == 0;
+        return true;
+    }
+    bool onStartObject() {
+        ++depth;
+        return true;
+    }
+    bool onEndObject(size_t) {
+        records += --depth == 0;
+        return true;
+    }
+};
+
+void test_ndjson() {
+    std::string lines;
+    double total = 0;
+    for (int i = 0; i < 5000; ++i) {
+        lines += "{\"id\":" + std::to_string(i) + ",\"s\":\"a\\nb\"}\n";
+        total += i;
+        if (i % 100 == 0)
+            lines += "\r\n" + std::to_string(i) + "\r\n"; // blank and scalar.
+        if (i % 100 == 0)
+            total += i;
+    }
+
+    ThreadPool pool(4);
+    NdjsonParser parser(pool);
+    parser.parse(lines.data(), lines.size());
+    assert(parser.size() == 5050);
+    double sum = 0;
+    for (size_t i = 0; i < parser.size(); ++i) {
+        const Value &root = parser[i];
+        if (root.isObject()) {
+            sum += root.getObject()["id"].getNumber().getNumber();
+            assert(root.getObject()["s"].getString().view() == "a\nb");
+        } else {
+            sum += root.getNumber().getNumber();
+        }
+    }
+    assert(sum == total);
+
+    std::vector<CountHandler> handlers(pool.concurrency());
+    assert(parser.parse(lines.data(), lines.size(), handlers));
+    size_t records = 0;
+    sum = 0;
+    for (const CountHandler &handler : handlers) {
+        records += handler.records;
+        sum += handler.sum;
+    }
+    assert(records == 5050 && sum == total);
+
+    // many small jobs, every iteration runs exactly once.
+    std::vector<int> hits(100000);
+    pool.run(hits.size(), [&](size_t, size_t i) { ++hits[i]; });
+    assert(std::count(hits.begin(), hits.end(), 1) == 100000);
+}
+
+void test_parallel() {
+    ThreadPool pool(4);
+
+    // chunks of 64 bytes make every block boundary a chunk boundary.
+    const char alphabet[] = "{}[]:, \t\n\"\"\\\\ab1";
+    srand(4);
+    StructuralIndex index, parallel;
+    for (int round = 0; round < 500; ++round) {
+        std::string json(rand() % 2000, ' ');
+        for (char &ch : json)
+            ch = alphabet[rand() % (sizeof(alphabet) - 1)];
+        bool closed = index.build(json.data(), json.size());
+        assert(parallel.build(json.data(), json.size(), pool, bestSimd(), 64) ==
+               closed);
+        assert(parallel.size() == index.size());
+        assert(std::equal(index.data(), index.data() + index.size() + 1,
+                          parallel.data()));
+        for (size_t i = 0; i < json.size(); i += 64)
+            assert(parallel.mayHaveBackslash(i, i + 1) ==
+                   index.mayHaveBackslash(i, i + 1));
+    }
+
+    std::string json = "[";
+    for (int i = 0; i < 50000; ++i)
+        json += (i ? ",{\"i\":" : "{\"i\":") + std::to_string(i) +
+                ",\"s\":\"]\\\\\\\"[,\",\"a\":[[],{},1.5e3,null]}";
+    json += "]";
+    FormatOptions compact;
+    compact.compact = true;
+    for (const std::string &text : {json, "{\"a\":" + json + ",\"b\":[]}"}) {
+        Document doc(text.data(), text.size());
+        doc.parse();
+        doc.format(compact);
+
+        ParallelDocument par(pool, text.data(), text.size());
+        par.parse();
+        Formatter formatter(compact);
+        formatter.format(par.root());
+        assert(std::string(formatter.data(), formatter.size()) ==
+               std::string(doc.formatter().data(), doc.formatter().size()));
+    }
+
+    ParallelDocument scalar(pool, " 42 ", 4);
+    scalar.parse();
+    assert(scalar.root().getNumber().getInt64() == 42);
+    ParallelDocument empty(pool, "[ ]", 3);
+    empty.parse();
+    assert(empty.root().getArray().size() == 0);
+}
+
+struct User {
+    std::string name;
+    uint32_t followers = 0;
+    bool verified = true;
+};
+
+struct Status {
+    int64_t id = 0;
+    std::string text;
+    User user;
+    std::vector<std::string> tags;
+    std::optional<double> score;
+};
+
+template <> struct nextjson::Binding<User> {
+    static constexpr auto fields =
+        std::make_tuple(field("name", &User::name),
+                        field("followers", &User::followers),
+                        field("verified", &User::verified));
+};
+
+template <> struct nextjson::Binding<Status> {
+    static constexpr auto fields = std::make_tuple(
+        field("id", &Status::id), field("text", &Status::text),
+        field("user", &Status::user), field("tags", &Status::tags),
+        field("score", &Status::score));
+};
+
+void test_binary() {
+    std::string json = "{\"a\":[1,-2,18446744073709551615,0.5,\"x\\\"y\"],"
+                       "\"b\":{\"c\":null,\"d\":true,\"e\":false},"
+                       "\"\":\"1234567\",\"f\":[]}";
+    Document doc(json.data(), json.size());
+    doc.parse();
+    BinaryWriter writer;
+    writer.write(doc.root());
+
+    // saved and mapped back.
+    const char *path = "/tmp/nextjson_test.bin";
+    FILE *file = fopen(path, "wb");
+    fwrite(writer.data(), 1, writer.size(), file);
+    fclose(file);
+    FileStream input(path);
+    BinaryDocument binary(input);
+
+    BinaryValue root = binary.root();
+    assert(root.isObject() && root.size() == 4);
+    BinaryValue a = root["a"];
+    assert(a.size() == 5 && a[1].getNumber().getInt64() == -2);
+    assert(a[2].getNumber().getUint64() == UINT64_MAX);
+    assert(a[3].getNumber().getNumber() == 0.5);
+    assert(a[4].getString().view() == "x\"y" && a[5].type() == kUnknown);
+    assert(root["b"]["c"].isNull() && root["b"]["d"].getBool());
+    assert(!root["b"]["e"].getBool() && root[""].getString().size() == 7);
+    assert(root["f"].size() == 0 && root["g"].type() == kUnknown);
+
+    // the round trip formats the same.
+    std::string text = format_value(doc.root());
+    assert(format_value(root.materialize()) == text);
+    Arena arena;
+    Value copy = root.materialize(&arena);
+    assert(!copy.isOwned() && format_value(copy) == text);
+
+    Value empty;
+    writer.write(empty);
+    BinaryDocument nothing(writer.data(), writer.size());
+    assert(nothing.valid() && nothing.root().type() == kUnknown);
+
+    // every cut of the tape is rejected, not read past its end.
+    writer.write(doc.root());
+    std::vector<uint64_t> words(writer.size() / sizeof(uint64_t));
+    std::memcpy(words.data(), writer.data(), writer.size());
+    for (size_t n = 0; n < words.size(); ++n) {
+        std::vector<uint64_t> cut(words.begin(), words.begin() + n);
+        BinaryDocument truncated(reinterpret_cast<const char *>(cut.data()),
+                                 n * sizeof(uint64_t));
+        assert(!truncated.valid() || n == 1);
+        assert(truncated.root().type() == kUnknown);
+    }
+    BinaryDocument whole(reinterpret_cast<const char *>(words.data()),
+                         writer.size() - 1);
+    assert(!whole.valid() && whole.root().type() == kUnknown);
+    words[2] = 1000; // the words of the root object.
+    BinaryDocument corrupt(reinterpret_cast<const char *>(words.data()),
+                           writer.size());
+    assert(!corrupt.valid());
+    remove(path);
+}
+
+void test_tape() {
+    std::string json = "{\"a\":[1,-2.5e3,true,null,[],{}],\"k\\u0065y\":"
+                       "\"tab\\there \\\"q\\\" \\u00e9\",\"n\":{\"m\":[[0]]}}";
+    Document doc(json.data(), json.size());
+    doc.parse();
+    TapeDocument tape(json.data(), json.size());
+    tape.parse();
+
+    BinaryValue root = tape.root();
+    assert(root.size() == 3 && root.key(1).getString().view() == "key");
+    assert(root["key"].getString().view() == "tab\there \"q\" \xc3\xa9");
+    assert(root["a"][1].getNumber().getNumber() == -2500);
+    assert(root["n"]["m"][0][0].getNumber().getInt64() == 0);
+
+    // formatting the tape matches formatting the tree.
+    FormatOptions compact;
+    compact.compact = true;
+    for (const FormatOptions &options : {FormatOptions(), compact}) {
+        Formatter tree(options), flat(options);
+        tree.format(doc.root());
+        flat.format(root);
+        assert(std::string(tree.data(), tree.size()) ==
+               std::string(flat.data(), flat.size()));
+    }
+
+    // the tape is the binary encoding.
+    BinaryWriter writer;
+    writer.write(doc.root());
+    assert(writer.size() == tape.size() &&
+           std::memcmp(writer.data(), tape.data(), tape.size()) == 0);
+    BinaryDocument binary(tape.data(), tape.size());
+    assert(binary.root()["a"].size() == 6);
+
+    tape.reset(" ", 1);
+    tape.parse();
+    assert(tape.root().type() == kUnknown);
+}
+
+void test_pointer() {
+    std::string json = "{\"user\":{\"id\":7,\"a/b\":1,\"m~n\":2},\"items\":"
+                       "[0,1,2,{\"price\":9.5}],\"tail\":[\"x\"]}";
+    Document doc(json.data(), json.size());
+    doc.parse();
+    const Value &root = doc.root();
+
+    Pointer price("/items/3/price");
+    assert(price.size() == 3 && price[1] == "3");
+    assert(price.find(root)->getNumber().getNumber() == 9.5);
+    assert(Pointer("").find(root) == &root);
+    assert(Pointer("/user/a~1b").find(root)->getNumber().getInt64() == 1);
+    assert(Pointer("/user/m~0n").find(root)->getNumber().getInt64() == 2);
+    assert(!Pointer("/items/4").find(root) && !Pointer("/items/-").find(root));
+    assert(!Pointer("/items/03").find(root) && !Pointer("/user/x").find(root));
+    assert(Pointer::path("items[3].price").find(root) == price.find(root));
+
+    LazyDocument lazy(json.data(), json.size());
+    lazy.parse();
+    assert(price.find(lazy.root()).getNumber().getNumber() == 9.5);
+    assert(!price.find(lazy.root()["user"]).isNumber());
+
+    // one pass for all pointers, it stops once they are all resolved.
+    Arena arena;
+    Parser parser(json.data(), json.size(), &arena);
+    PointerQuery query({Pointer("/user/id"), Pointer("/items/3"),
+                        Pointer("/items/3/price"), Pointer("/user/none"),
+                        Pointer("/items/9")},
+                       &arena);
+    assert(!parser.parse(query) && query.done());
+    assert(query[0]->getNumber().getInt64() == 7);
+    const Object &item = query[1]->getObject();
+    assert(query[2] == item.find("price"));
+    assert(!query[3] && !query[4]);
+
+    PointerQuery tail({Pointer("/tail/0")}, &arena);
+    assert(!parser.parse(tail) && tail[0]->getString().view() == "x");
+    PointerQuery missing({Pointer("/nothing")}, &arena);
+    assert(!parser.parse(missing) && missing.done() && !missing[0]);
+
+    // the broken literal after the value is never read.
+    std::string early = "{\"a\":{\"b\":1},\"c\":[nul]}";
+    parser.reset(early.data(), early.size());
+    PointerQuery first({Pointer("/a/b")}, &arena);
+    assert(!parser.parse(first) && first[0]->getNumber().getInt64() == 1);
+
+    // a malformed pointer finds nothing, not the root.
+    for (const char *bad : {"a", "/a~", "/a~2"}) {
+        Pointer pointer(bad);
+        assert(!pointer.ok() && pointer.size() == 0);
+        assert(!pointer.find(root) && pointer.find(lazy.root()).type() ==
+                                          kUnknown);
+    }
+    assert(Pointer("/a~1").ok() && Pointer::path("a").ok());
+    PointerQuery bad({Pointer("/user/id"), Pointer("user")}, &arena);
+    parser.reset(json.data(), json.size());
+    assert(!parser.parse(bad) && bad[0] && !bad[1]);
+}
+
+void test_binding() {
+    static_assert(detail::BindingTable<Status>::value.find("user") == 2);
+    static_assert(detail::BindingTable<Status>::value.find("users") == -1);
+
+    std::string json = "[{\"id\":-7,\"t\\u0065xt\":\"a\\nb\",\"extra\":"
+                       "[{\"x\":[1,\"]\"]},null],\"user\":{\"name\":\"u\","
+                       "\"followers\":12,\"verified\":false},\"tags\":"
+                       "[\"x\",\"y\"],\"score\":1.5},{\"score\":null}]";
+    std::vector<Status> statuses;
+    Binder binder(json.data(), json.size());
+    assert(binder.parse(statuses) && statuses.size() == 2);
+    const Status &status = statuses[0];
+    assert(status.id == -7 && status.text == "a\nb");
+    assert(status.user.name == "u" && status.user.followers == 12);
+    assert(!status.user.verified && status.tags.size() == 2);
+    assert(status.tags[1] == "y" && status.score == 1.5);
+    assert(!statuses[1].score && statuses[1].user.verified);
+
+    // the document has to fit the types.
+    User user;
+    std::string negative = "{\"followers\":-1}";
+    binder.reset(negative.data(), negative.size());
+    assert(!binder.parse(user));
+    std::string zero = "{\"followers\":-0}";
+    binder.reset(zero.data(), zero.size());
+    assert(binder.parse(user) && user.followers == 0);
+    std::string text = "{\"name\":3}";
+    binder.reset(text.data(), text.size());
+    assert(!binder.parse(user));
+    std::string array = "[]";
+    binder.reset(array.data(), array.size());
+    assert(!binder.parse(user));
+}
+
+void test_parse_error() {
+    struct Case {
+        const char *json;
+        ParseError error;
+        size_t offset;
+    };
+    const Case cases[] = {{"\"abc", kUnterminatedString, 0},
+                          {"[1,]", kExpectedValue, 3},
+                          {"]", kExpectedValue, 0},
+                          {"[}", kExpectedValue, 1},
+                          {"[1 2]", kExpectedCommaOrEnd, 3},
+                          {"[1}", kExpectedCommaOrEnd, 2},
+                          {"{\"a\" 1}", kExpectedColon, 5},
+                          {"{1:2}", kExpectedKey, 1},
+                          {"[tru]", kInvalidLiteral, 1},
+                          {"[nulls]", kInvalidLiteral, 1},
+                          {"-x", kInvalidNumber, 0},
+                          {"[1.]", kInvalidNumber, 1},
+                          {"1e999", kInvalidNumber, 0},
+                          {"[1", kUnexpectedEnd, 2},
+                          {"{\"a\":1", kUnexpectedEnd, 6},
+                          {"[]]", kTrailingCharacters, 2},
+                          {"1 2", kTrailingCharacters, 2}};
+    for (const Case &c : cases) {
+        size_t n = std::strlen(c.json);
+        Document doc(c.json);
+        ParseResult result = doc.parse();
+        assert(!result && result.error() == c.error);
+        assert(result.offset() == c.offset && doc.root().type() == kUnknown);
+
+        TapeDocument tape(c.json);
+        assert(tape.parse().error() == c.error);
+        assert(tape.root().type() == kUnknown);
+
+        // the same error and offset whatever the chunks.
+        for (size_t chunk : {n, size_t(1)}) {
+            Arena arena;
+            PushParser parser(&arena);
+            for (size_t i = 0; i < n; i += chunk)
+                parser.feed(c.json + i, std::min(chunk, n - i));
+            assert(parser.finish().type() == kUnknown);
+            assert(parser.result().error() == c.error);
+            assert(parser.result().offset() == c.offset);
+        }
+    }
+
+    Document ok(" [1] ");
+    assert(ok.parse().ok() && ok.parse().message() == "No error");
+
+    // line and column are counted on failure only.
+    const char *lines = "{\n  \"a\": 1,\n  \"b\" 2\n}";
+    Document doc(lines);
+    ParseResult result = doc.parse();
+    assert(result.line() == 3 && result.column() == 7);
+    assert(result.message() == "Expected ':' at line 3, column 7");
+    Arena arena;
+    PushParser push(&arena);
+    push.feed(lines, std::strlen(lines));
+    assert(push.result().line() == 0);
+    assert(push.result().message() == "Expected ':' at offset 18");
+
+    ParseOptions shallow;
+    shallow.maxDepth = 2;
+    Document deep("[[[]]]", shallow);
+    result = deep.parse();
+    assert(result.error() == kTooDeep && result.offset() == 2);
+
+    // parallel and lazy documents check brackets themselves.
+    ThreadPool pool(2);
+    const Case brackets[] = {{"[1,2 3]", kExpectedCommaOrEnd, 5},
+                             {"[1}", kExpectedCommaOrEnd, 2},
+                             {"[1,[2}]", kExpectedCommaOrEnd, 5},
+                             {"[1]2", kTrailingCharacters, 3},
+                             {"[[1]", kUnexpectedEnd, 4},
+                             {"[\"a", kUnterminatedString, 1}};
+    for (const Case &c : brackets) {
+        size_t n = std::strlen(c.json);
+        ParallelDocument par(pool, c.json, n);
+        result = par.parse();
+        assert(result.error() == c.error && result.offset() == c.offset);
+        assert(par.root().type() == kUnknown);
+        LazyDocument lazy(c.json);
+        result = lazy.parse();
+        assert(result.error() == c.error && result.offset() == c.offset);
+        assert(lazy.root().type() == kUnknown);
+    }
+
+    // the lazy document also checks the tokens between brackets.
+    const Case tokens[] = {{"{\"a\" 1}", kExpectedColon, 5},
+                           {"{\"a\":1 \"b\":2}", kExpectedCommaOrEnd, 7},
+                           {"{\"a\":}", kExpectedValue, 5},
+                           {"{\"a\":1,,}", kExpectedKey, 7},
+                           {"{\"a\":1,}", kExpectedKey, 7},
+                           {"{1:2}", kExpectedKey, 1},
+                           {"[1,]", kExpectedValue, 3},
+                           {"[,1]", kExpectedValue, 1},
+                           {"[1:2]", kExpectedCommaOrEnd, 2},
+                           {"1 2", kTrailingCharacters, 2},
+                           {",", kExpectedValue, 0}};
+    for (const Case &c : tokens) {
+        LazyDocument lazy(c.json);
+        result = lazy.parse();
+        assert(result.error() == c.error && result.offset() == c.offset);
+        assert(lazy.root().type() == kUnknown);
+        Document doc(c.json);
+        assert(doc.parse().error() == c.error);
+    }
+    // malformed scalars are unknown values.
+    LazyDocument scalars("[tru,true ,nul,falsey,1.,-,2 ,\"s\"]");
+    assert(scalars.parse().error() == kNoError);
+    LazyValue values = scalars.root();
+    assert(values[0].type() == kUnknown && values[1].getBool());
+    assert(values[2].type() == kUnknown && values[3].type() == kUnknown);
+    assert(values[4].type() == kUnknown && values[5].type() == kUnknown);
+    assert(values[6].getNumber().getInt64() == 2 && values[7].isString());
+    LazyDocument nested("{\"a\":[{},[]],\"b\":{\"c\":null}}");
+    assert(nested.parse().error() == kNoError);
+    assert(nested.root()["b"]["c"].isNull());
+    assert(nested.root()["a"].size() == 2);
+
+    // the first malformed record, its line is the record's.
+    std::string records = "{\"a\":1}\n{\"a\":}\n[1]\n[";
+    NdjsonParser ndjson(pool);
+    result = ndjson.parse(records.data(), records.size());
+    assert(result.error() == kExpectedValue && result.line() == 2);
+    assert(result.column() == 6 && ndjson[1].type() == kUnknown);
+    assert(ndjson[0].isObject() && ndjson[2].isArray());
+
+    // a syntax error is not a type mismatch.
+    User user;
+    std::string cut = "{\"name\":\"u\"";
+    Binder binder(cut.data(), cut.size());
+    assert(!binder.parse(user) && binder.result().error() == kUnexpectedEnd);
+    std::string text = "{\"name\":3}";
+    binder.reset(text.data(), text.size());
+    assert(!binder.parse(user) && binder.result().error() == kTypeMismatch);
+    assert(binder.result().offset() == 8);
+
+    // values under unknown keys are checked too.
+    const Case skipped[] = {
+        {"{\"u\":[1 2},\"followers\":1}", kExpectedCommaOrEnd, 8},
+        {"{\"u\":{1:2:3],\"followers\":1}", kExpectedKey, 6},
+        {"{\"u\":tru,\"followers\":1}", kInvalidLiteral, 5},
+        {"{\"u\":[1}}", kExpectedCommaOrEnd, 7},
+        {"{\"u\":[[", kUnexpectedEnd, 7}};
+    for (const Case &c : skipped) {
+        binder.reset(c.json, std::strlen(c.json));
+        assert(!binder.parse(user));
+        assert(binder.result().error() == c.error);
+        assert(binder.result().offset() == c.offset);
+    }
+}
+
+// Offset of the first malformed UTF-8 sequence of json, a sequence cut by
+// the end of input is malformed at its lead.
+size_t scalar_utf8(const std::string &json) {
+    auto p = reinterpret_cast<const uint8_t *>(json.data());
+    for (size_t i = 0; i < json.size();) {
+        int n = detail::utf8Sequence(p + i, p + json.size());
+        if (n <= 0)
+            return i;
+        i += n;
+    }
+    return SIZE_MAX;
+}
+
+void test_utf8() {
+    // mostly valid text, so that errors fall anywhere in the blocks.
+    const char *pieces[] = {"a",        "\"",       " ",        "\xc3\xa9",
+                            "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\x80",
+                            "\xc0",     "\xe0\x80", "\xed\xa0", "\xf4\x90",
+                            "\xff",     "\xe2",     "\xf0\x9f"};
+    srand(5);
+    ThreadPool pool(4);
+    StructuralIndex index, parallel;
+    for (int round = 0; round < 3000; ++round) {
+        std::string json;
+        size_t n = rand() % 200;
+        while (json.size() < n) {
+            int piece = rand() % 64;
+            json += pieces[piece < 58 ? piece % 6 : piece - 52];
+        }
+        size_t expected = scalar_utf8(json);
+
+        for (int level = kSimdScalar; level <= kSimdNeon; ++level) {
+            if (!simdSupported(SimdLevel(level)))
+                continue;
+            index.build(json.data(), json.size(), SimdLevel(level));
+            assert(index.invalidUtf8() == expected);
+        }
+        parallel.build(json.data(), json.size(), pool, bestSimd(), 64);
+        assert(parallel.invalidUtf8() == expected);
+    }
+
+    struct Case {
+        std::string json;
+        ParseError error;
+        size_t offset;
+    };
+    const Case cases[] = {
+        {"\"\xc0\xaf\"", kInvalidUtf8, 1},         // overlong '/'.
+        {"[\"\xed\xa0\x80\"]", kInvalidUtf8, 2},   // surrogate.
+        {"[\"ab\xe2\x82\"]", kInvalidUtf8, 4},     // cut short.
+        {"\"\xf4\x90\x80\x80\"", kInvalidUtf8, 1}, // above U+10FFFF.
+        {"{\"k\":\"a\xff\"}", kInvalidUtf8, 7},
+        {"\"" + std::string(61, 'a') + "\xe2\x82x\"", kInvalidUtf8, 62},
+        {"\"a\tb\"", kControlCharacter, 2},
+        {"[1,\"" + std::string(70, 'a') + "\n\"]", kControlCharacter, 74},
+        {"[\"a\\x\"]", kInvalidEscape, 3},
+        {"\"\\u12g4\"", kInvalidEscape, 1},
+        {"[\"\\u12\"]", kInvalidEscape, 2},
+        {"{\"\\q\":1}", kInvalidEscape, 2},
+        // the escape is in a later block than the string starts in.
+        {"[\"" + std::string(70, 'a') + "\\x\"]", kInvalidEscape, 72}};
+    for (const Case &c : cases) {
+        Document doc(c.json.data(), c.json.size());
+        ParseResult result = doc.parse();
+        assert(result.error() == c.error && result.offset() == c.offset);
+
+        for (size_t chunk : {c.json.size(), size_t(1)}) {
+            Arena arena;
+            PushParser parser(&arena);
+            for (size_t i = 0; i < c.json.size(); i += chunk)
+                parser.feed(c.json.data() + i,
+                            std::min(chunk, c.json.size() - i));
+            assert(parser.finish().type() == kUnknown);
+            assert(parser.result().error() == c.error);
+            assert(parser.result().offset() == c.offset);
+        }
+
+        ParallelDocument par(pool, c.json.data(), c.json.size());
+        result = par.parse();
+        assert(result.error() == c.error && result.offset() == c.offset);
+    }
+
+    // a sequence cut by the end of a 64 byte input, outside any string.
+    std::string cut = std::string(63, ' ') + "\xe2";
+    Document doc(cut.data(), cut.size());
+    ParseResult result = doc.parse();
+    assert(result.error() == kInvalidUtf8 && result.offset() == 63);
+
+    // across a block boundary, and lone surrogates decoded to U+FFFD.
+    std::string text = "[\"" + std::string(60, 'a') +
+                       "\xe2\x82\xac\xc3\xa9\xf0\x9f\x98\x80\", "
+                       "\"\\ud800\", \"\\u00e9\\/\\t\"]";
+    Document valid(text.data(), text.size());
+    assert(valid.parse().ok());
+    const Array &arr = valid.root().getArray();
+    assert(arr[0].getString().view() == std::string(60, 'a') +
+                                            "\xe2\x82\xac\xc3\xa9"
+                                            "\xf0\x9f\x98\x80");
+    assert(arr[1].getString().view() == "\xef\xbf\xbd");
+    assert(arr[2].getString().view() == "\xc3\xa9/\t");
+}
+
+// A heap copy of the document json, so it outlives its Document.
+Value parse_value(const char *json) {
+    Document doc(json);
+    assert(doc.parse().ok());
+    return doc.root();
+}
+
+std::string compact_value(const Value &value) {
+    FormatOptions compact;
+    compact.compact = true;
+    Formatter formatter(compact);
+    formatter.format(value);
+    return std::string(formatter.data(), formatter.size());
+}
+
+void test_mutation() {
+    // values going into an arena array are copied into the arena.
+    Arena arena;
+    Array arr(&arena);
+    arr.add(Value(1));
+    arr.insert(0, Value(String("s")));
+    arr.set(1, Value(String("t")));
+    assert(!arr[0].isOwned() && !arr[1].isOwned() && arr.size() == 2);
+    arr.erase(0);
+    assert(arr[0].getString().view() == "t");
+
+    // enough members for the keys to be indexed.
+    std::string json = "{\"list\":[1,2,3],";
+    for (int i = 0; i < 20; ++i)
+        json += "\"k" + std::to_string(i) + "\":" + std::to_string(i) + ",";
+    json += "\"last\":null}";
+    Document doc(json.data(), json.size());
+    doc.parse();
+    Value &root = doc.root();
+    Object &obj = root.getObject();
+    assert(obj.find("k5") && obj.find("k5")->getNumber().getInt64() == 5);
+
+    Array &list = obj.find("list")->getArray();
+    list.set(0, Value(String("one")));
+    list.insert(1, Value(kNull));
+    list.insert(4, Value(4));
+    list.erase(2);
+    assert(compact_value(*obj.find("list")) == "[\"one\",null,3,4]");
+
+    // the key index follows members moving down.
+    assert(obj.erase("k5") == 1 && obj.erase("k5") == 0);
+    assert(!obj.find("k5") && obj.find("k6")->getNumber().getInt64() == 6);
+    obj.erase(0);
+    assert(!obj.find("list") && obj.size() == 20);
+    obj.set("k7", Value(70));
+    obj.set("new", Value(String("x")));
+    assert(obj.find("k7")->getNumber().getInt64() == 70);
+    assert(obj[obj.size() - 1].first.getString().view() == "new");
+    obj.insert(1, Value(String("ins")), Value(String("v")));
+    assert(obj[1].first.getString().view() == "ins");
+    assert(!obj[1].second.isOwned());
+    assert(obj.find("ins")->getString().view() == "v" && obj.erase("ins"));
+
+    // the document was edited in its arena, a copy leaves it.
+    assert(!root.isOwned() && &doc.root().getObject() == &obj);
+    Value copy = root;
+    copy.getObject().set("k0", Value(kTrue));
+    assert(root.getObject()["k0"].getNumber().getInt64() == 0);
+    assert(copy != root && copy.getObject()["k0"].isBool());
+    copy.getObject().set("k0", Value(0));
+    assert(copy == root);
+
+    assert(parse_value("{\"a\":[1,2.0],\"b\":\"s\"}") ==
+           parse_value("{\"b\":\"s\",\"a\":[1,2]}"));
+    assert(parse_value("[1,2]") != parse_value("[2,1]"));
+}
+
+void test_merge_patch() {
+    // RFC 7396 appendix A.
+    const char *cases[][3] = {
+        {"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+        {"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+        {"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+        {"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+        {"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+        {"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+        {"{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}",
+         "{\"a\":{\"b\":\"d\"}}"},
+        {"{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"},
+        {"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+        {"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+        {"{\"a\":\"foo\"}", "null", "null"},
+        {"{\"a\":\"foo\"}", "\"bar\"", "\"bar\""},
+        {"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+        {"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+        {"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"}};
+    for (const auto &c : cases) {
+        Value target = parse_value(c[0]);
+        mergePatch(target, parse_value(c[1]));
+        assert(compact_value(target) == c[2]);
+    }
+
+    // merged into the parsed tree.
+    Document doc("{\"a\":{\"b\":1,\"c\":[]},\"d\":2}");
+    doc.parse();
+    const Object *a = &doc.root().getObject()["a"].getObject();
+    mergePatch(doc.root(), parse_value("{\"a\":{\"b\":null,\"e\":\"s\"}}"));
+    assert(compact_value(doc.root()) ==
+           "{\"a\":{\"c\":[],\"e\":\"s\"},\"d\":2}");
+    assert(!doc.root().isOwned());
+    assert(&doc.root().getObject()["a"].getObject() == a);
+    assert(!a->find("e")->isOwned());
+}
+
+void test_json_patch() {
+    // RFC 6902 appendix A, and failures that leave the document alone.
+    const char *cases[][3] = {
+        {"{\"foo\":\"bar\"}",
+         "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]",
+         "{\"foo\":\"bar\",\"baz\":\"qux\"}"},
+        {"{\"foo\":[\"bar\",\"baz\"]}",
+         "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]",
+         "{\"foo\":[\"bar\",\"qux\",\"baz\"]}"},
+        {"{\"foo\":[\"bar\"]}",
+         "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\"]}]",
+         "{\"foo\":[\"bar\",[\"abc\"]]}"},
+        {"{\"baz\":\"qux\",\"foo\":\"bar\"}",
+         "[{\"op\":\"remove\",\"path\":\"/baz\"}]", "{\"foo\":\"bar\"}"},
+        {"{\"foo\":[\"bar\",\"qux\",\"baz\"]}",
+         "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]",
+         "{\"foo\":[\"bar\",\"baz\"]}"},
+        {"{\"baz\":\"qux\",\"foo\":\"bar\"}",
+         "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]",
+         "{\"baz\":\"boo\",\"foo\":\"bar\"}"},
+        {"{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{}}",
+         "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]",
+         "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"thud\":\"fred\"}}"},
+        {"{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+         "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+         "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}"},
+        {"{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+         "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},"
+         "{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2.0}]",
+         "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}"},
+        {"{\"foo\":\"bar\"}",
+         "[{\"op\":\"copy\",\"from\":\"/foo\",\"path\":\"/child\"},"
+         "{\"op\":\"add\",\"path\":\"/~1a~0b\",\"value\":{\"c\":[]}}]",
+         "{\"foo\":\"bar\",\"child\":\"bar\",\"/a~b\":{\"c\":[]}}"},
+        {"{\"foo\":\"bar\"}",
+         "[{\"op\":\"replace\",\"path\":\"\",\"value\":1}]", "1"}};
+    for (const auto &c : cases) {
+        Value target = parse_value(c[0]);
+        assert(applyPatch(target, parse_value(c[1])));
+        assert(compact_value(target) == c[2]);
+    }
+
+    const char *failures[] = {
+        "[{\"op\":\"add\",\"path\":\"/a\",\"value\":1},"
+        "{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]",
+        "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":\"qux\"}]",
+        "[{\"op\":\"remove\",\"path\":\"/missing\"}]",
+        "[{\"op\":\"add\",\"path\":\"/list/3\",\"value\":1}]",
+        "[{\"op\":\"add\",\"path\":\"/list/01\",\"value\":1}]",
+        "[{\"op\":\"replace\",\"path\":\"/list/2\",\"value\":1}]",
+        "[{\"op\":\"move\",\"from\":\"/list\",\"path\":\"/list/0\"}]",
+        "[{\"op\":\"add\",\"path\":\"a\",\"value\":1}]",
+        "[{\"op\":\"add\",\"path\":\"/a~2\",\"value\":1}]",
+        "[{\"op\":\"add\",\"path\":\"/a\"}]",
+        "[{\"op\":\"jump\",\"path\":\"/a\"}]",
+        "{\"op\":\"add\",\"path\":\"/a\",\"value\":1}"};
+    for (const char *patch : failures) {
+        Value target = parse_value("{\"baz\":\"qux\",\"list\":[1,2]}");
+        Value before = target;
+        assert(!applyPatch(target, parse_value(patch)));
+        assert(target == before);
+    }
+
+    // a parsed document is patched in place, a failed patch is undone.
+    Document doc("{\"a\":{\"b\":[1,2]},\"k\":1,\"x\":0,\"k\":2}");
+    doc.parse();
+    std::string text = compact_value(doc.root());
+    const Array *b = &doc.root().getObject()["a"].getObject()["b"].getArray();
+    Value undone = parse_value(
+        "[{\"op\":\"remove\",\"path\":\"/k\"},"
+        "{\"op\":\"replace\",\"path\":\"/a/b/0\",\"value\":\"s\"},"
+        "{\"op\":\"add\",\"path\":\"/a/b/-\",\"value\":{\"c\":3}},"
+        "{\"op\":\"remove\",\"path\":\"/a/b/1\"},"
+        "{\"op\":\"add\",\"path\":\"/n\",\"value\":[]},"
+        "{\"op\":\"add\",\"path\":\"/x\",\"value\":5},"
+        "{\"op\":\"move\",\"from\":\"/x\",\"path\":\"/a/y\"},"
+        "{\"op\":\"replace\",\"path\":\"\",\"value\":1},"
+        "{\"op\":\"remove\",\"path\":\"/missing\"}]");
+    assert(!applyPatch(doc.root(), undone));
+    assert(compact_value(doc.root()) == text && !doc.root().isOwned());
+    assert(&doc.root().getObject()["a"].getObject()["b"].getArray() == b);
+
+    Value patch = parse_value(
+        "[{\"op\":\"add\",\"path\":\"/a/b/-\",\"value\":3},"
+        "{\"op\":\"remove\",\"path\":\"/k\"}]");
+    assert(applyPatch(doc.root(), patch));
+    assert(compact_value(doc.root()) == "{\"a\":{\"b\":[1,2,3]},\"x\":0}");
+    assert(!doc.root().isOwned() && b->size() == 3 && !(*b)[2].isOwned());
+}
+
+void test_splice() {
+    const char *json = "{ \"user\": {\"name\": \"ann\", \"age\": 30},\n"
+                       "  \"tags\": [\"a\", \"b\", \"c\"],\n"
+                       "  \"debug\": true, \"n\": 7 }";
+    LazyDocument doc(json);
+    assert(doc.parse().ok());
+
+    // nothing edited, the input comes back as it was.
+    Splice splice(doc);
+    assert(splice.str() == json);
+
+    assert(splice.replace(Pointer("/user/name"), Value(String("bo\"b"))));
+    assert(splice.replace(Pointer("/n"), Value(8)));
+    assert(splice.str() == "{ \"user\": {\"name\": \"bo\\\"b\", \"age\": 30},\n"
+                           "  \"tags\": [\"a\", \"b\", \"c\"],\n"
+                           "  \"debug\": true, \"n\": 8 }");
+
+    // members change in place, the changed containers lose the spacing
+    // between members.
+    assert(splice.remove(Pointer("/debug")));
+    assert(splice.remove(Pointer("/tags/1")));
+    assert(splice.add(Pointer("/tags/0"), Value(String("z"))));
+    assert(splice.add(Pointer("/tags/-"), Value(kNull)));
+    assert(splice.add(Pointer("/user/id"), Value(1)));
+    assert(splice.str() ==
+           "{\"user\": {\"name\": \"bo\\\"b\",\"age\": 30,\"id\":1},"
+           "\"tags\": [\"z\",\"a\",\"c\",null],\"n\": 8}");
+
+    // the edited result parses to the same tree as patching the DOM.
+    std::string out = splice.str();
+    Value patched = parse_value(json);
+    assert(applyPatch(patched, parse_value(
+        "[{\"op\":\"replace\",\"path\":\"/user/name\",\"value\":\"bo\\\"b\"},"
+        "{\"op\":\"replace\",\"path\":\"/n\",\"value\":8},"
+        "{\"op\":\"remove\",\"path\":\"/debug\"},"
+        "{\"op\":\"remove\",\"path\":\"/tags/1\"},"
+        "{\"op\":\"add\",\"path\":\"/tags/0\",\"value\":\"z\"},"
+        "{\"op\":\"add\",\"path\":\"/tags/-\",\"value\":null},"
+        "{\"op\":\"add\",\"path\":\"/user/id\",\"value\":1}]")));
+    assert(parse_value(out.c_str()) == patched);
+
+    // written in chunks, long spans of the input go as they are. Each
+    // value added here is shorter than 8 bytes.
+    for (size_t chunk : {size_t(1), size_t(8), size_t(64 * 1024)}) {
+        std::string streamed;
+        size_t writes = 0;
+        CallbackSink sink([&](const char *data, size_t n) {
+            bool input = data >= json && data < json + std::strlen(json);
+            assert(chunk == 1 || n <= chunk || input);
+            streamed.append(data, n);
+            ++writes;
+        });
+        splice.write(sink, chunk);
+        assert(streamed == out && (chunk < out.size()) == (writes > 1));
+    }
+
+    // removed or replaced values take no more edits, a replaced parent
+    // drops the edits below it.
+    assert(!splice.remove(Pointer("/debug")));
+    assert(!splice.replace(Pointer("/missing"), Value(1)));
+    assert(!splice.add(Pointer("/tags/9"), Value(1)));
+    assert(splice.replace(Pointer("/user"), Value(kFalse)));
+    assert(!splice.replace(Pointer("/user/age"), Value(1)));
+    assert(splice.str() == "{\"user\": false,"
+                           "\"tags\": [\"z\",\"a\",\"c\",null],\"n\": 8}");
+
+    LazyDocument empty("{\"a\":[]}");
+    assert(empty.parse().ok());
+    Splice fill(empty);
+    assert(fill.add(Pointer("/a/0"), Value(1)) && fill.remove(Pointer("/a")));
+    assert(fill.add(Pointer("/b"), Value(String("x"))));
+    assert(fill.str() == "{\"b\":\"x\"}");
+    assert(fill.replace(Pointer(""), Value(2)) && fill.str() == "2");
+}
+
+void test_file() {
+    nextjson::FileStream input("../json_file/array.json");
     nextjson::Document doc(input);
 
-    // json::Document doc("[false,true,123,null, \"string\", {\"key\":3.14156}]");
-    // json::Document doc("[false]");
     doc.parse();
     doc.format();
-    std::cout << "alloc size: " << size << std::endl;
-}
\ No newline at end of file
+    std::cout << "alloc size: " << size.load() << std::endl;
+}
+
+int main() {
+    test_value();
+    test_scalar_no_alloc();
+    test_arena();
+    test_zero_copy();
+    test_structural_index();
+    test_deep_nesting();
+    test_number();
+    test_format_number();
+    test_format_options();
+    test_format_escape();
+    test_sink();
+    test_document_pool();
+    test_stats();
+    test_move();
+    test_snapshot();
+    test_object_index();
+    test_concurrent_read();
+    test_file_stream();
+    test_push_parser();
+    test_sax();
+    test_lazy_document();
+    test_ndjson();
+    test_parallel();
+    test_binary();
+    test_tape();
+    test_pointer();
+    test_binding();
+    test_parse_error();
+    test_utf8();
+    test_mutation();
+    test_merge_patch();
+    test_json_patch();
+    test_splice();
+    test_file();
+}